@@ -0,0 +1,73 @@
+#!/bin/sh
+#
+# Measure CREATE EXTENSION time and catalog growth on a database with a lot of
+# types, for each variant.install_casts mode.
+#
+# Usage: bench/install.sh results_file
+#
+# Uses the usual libpq environment variables to connect; creates and drops
+# scratch databases named variant_bench_*. Tunables, all set by make
+# bench-install:
+#
+#   BENCH_TYPES    number of types to create (half enums, half their arrays)
+#   EXTVERSION     version of variant being tested; recorded in results
+#
+# Every line of the results is one install:
+#
+#   extversion,server_version,types,mode,install_ms,casts,functions,catalog_kb
+
+set -e
+
+results=${1:-bench_install.csv}
+types=${BENCH_TYPES:-5000}
+extversion=${EXTVERSION:-unknown}
+template=variant_bench_types
+db=variant_bench_install
+
+PSQL="psql -X -q -v ON_ERROR_STOP=1"
+
+now() {
+  # Milliseconds; date +%N isn't portable so fall back to perl
+  perl -MTime::HiRes=time -e 'printf "%.3f\n", time * 1000'
+}
+
+cleanup() {
+  dropdb --if-exists $db
+  dropdb --if-exists $template
+}
+trap cleanup EXIT
+
+echo "Creating $types types"
+dropdb --if-exists $template
+createdb $template
+$PSQL -d $template -v enums=`expr $types / 2` <<'SQL'
+SELECT format( 'CREATE TYPE bench_enum_%s AS ENUM( ''a'', ''b'' )', i ) FROM generate_series( 1, :enums ) i
+\gexec
+SQL
+server_version=`$PSQL -d $template -At -c 'SHOW server_version'`
+
+stats="SELECT (SELECT count(*) FROM pg_cast) || ',' || (SELECT count(*) FROM pg_proc) || ',' || (pg_total_relation_size('pg_cast') + pg_total_relation_size('pg_proc')) / 1024"
+
+echo "extversion,server_version,types,mode,install_ms,casts,functions,catalog_kb" > "$results"
+
+for mode in all none int4,text
+do
+  dropdb --if-exists $db
+  createdb -T $template $db
+  before=`$PSQL -d $db -At -c "$stats"`
+
+  start=`now`
+  PGOPTIONS="$PGOPTIONS -c variant.install_casts=$mode" $PSQL -d $db -c 'CREATE EXTENSION variant'
+  end=`now`
+  after=`$PSQL -d $db -At -c "$stats"`
+
+  line=`echo "$before $after" | tr ',' ' ' |
+    awk '{ printf "%d,%d,%d", $4 - $1, $5 - $2, $6 - $3 }'`
+  ms=`echo "$start $end" | awk '{ printf "%.3f", $2 - $1 }'`
+  printf '%-10s %10s ms  casts,functions,catalog_kb %s\n' "$mode" "$ms" "$line"
+  echo "$extversion,$server_version,$types,\"$mode\",$ms,$line" >> "$results"
+done
+
+echo "Results written to $results"
+
+# vi: expandtab sw=2 ts=2
@@ -0,0 +1,92 @@
+#!/bin/sh
+#
+# Run the benchmarks listed in bench/bench.txt and write the results as CSV.
+#
+# Usage: bench/run.sh results_file
+#
+# Uses the usual libpq environment variables (PGDATABASE etc) to find the
+# database. Tunables, all set by make bench:
+#
+#   BENCH_ROWS     rows in bench_data
+#   BENCH_TIME     seconds to run each pgbench test
+#   BENCH_LOOPS    iterations for each psql test
+#   EXTVERSION     version of variant being tested; recorded in results
+#
+# Every line of the results is one test run:
+#
+#   extversion,server_version,test,impl,tps,latency_ms
+
+set -e
+
+results=${1:-bench_results.csv}
+dir=`dirname "$0"`
+rows=${BENCH_ROWS:-100000}
+time=${BENCH_TIME:-10}
+loops=${BENCH_LOOPS:-10}
+extversion=${EXTVERSION:-unknown}
+
+PSQL="psql -X -q -v ON_ERROR_STOP=1"
+
+tmp=`mktemp -d "${TMPDIR:-/tmp}/variant_bench.XXXXXX"`
+trap 'rm -rf "$tmp"' EXIT
+
+echo "Generating $rows rows of test data"
+$PSQL -v rows=$rows -f "$dir/setup.sql"
+server_version=`$PSQL -At -c 'SHOW server_version'`
+
+# Data files for COPY in
+$PSQL -c "\\copy (SELECT v_int, v_text, v_uuid FROM bench_data) TO '$tmp/variant.dat'"
+$PSQL -c "\\copy (SELECT n_int, n_text, n_uuid FROM bench_data) TO '$tmp/native.dat'"
+$PSQL -c "\\copy (SELECT j_int, j_text, j_uuid FROM bench_data) TO '$tmp/jsonb.dat'"
+
+now() {
+  # Milliseconds; date +%N isn't portable so fall back to perl
+  perl -MTime::HiRes=time -e 'printf "%.3f\n", time * 1000'
+}
+
+echo "extversion,server_version,test,impl,tps,latency_ms" > "$results"
+
+grep -v -e '^#' -e '^[[:space:]]*$' "$dir/bench.txt" |
+while IFS='|' read -r test impl runner cmd
+do
+  cmd=`echo "$cmd" | sed -e "s|@COPY_DIR@|$tmp|g"`
+  printf '%-16s %-8s ' "$test" "$impl"
+
+  case "$runner" in
+    pgbench)
+      echo "$cmd" > "$tmp/script.sql"
+      out=`pgbench -n -f "$tmp/script.sql" -T $time -c 1 2>&1` || {
+        echo "FAILED"; echo "$out"; exit 1
+      }
+      tps=`echo "$out" | sed -n -e 's/^tps = \([0-9.]*\) .*/\1/p' | tail -1`
+      latency=`echo "$out" | sed -n -e 's/^latency average *[:=] *\([0-9.]*\) ms.*/\1/p'`
+      if [ -z "$latency" ]; then
+        latency=`echo "$tps" | awk '{ printf "%.3f", 1000 / $1 }'`
+      fi
+      ;;
+    psql)
+      : > "$tmp/script.sql"
+      i=0
+      while [ $i -lt $loops ]; do
+        echo "$cmd" >> "$tmp/script.sql"
+        i=`expr $i + 1`
+      done
+      start=`now`
+      $PSQL -f "$tmp/script.sql" > /dev/null
+      end=`now`
+      latency=`echo "$start $end $loops" | awk '{ printf "%.3f", ($2 - $1) / $3 }'`
+      tps=`echo "$latency" | awk '{ printf "%.3f", 1000 / $1 }'`
+      ;;
+    *)
+      echo "unknown runner $runner"
+      exit 1
+      ;;
+  esac
+
+  echo "tps $tps latency $latency ms"
+  echo "$extversion,$server_version,$test,$impl,$tps,$latency" >> "$results"
+done
+
+echo "Results written to $results"
+
+# vi: expandtab sw=2 ts=2
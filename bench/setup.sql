@@ -0,0 +1,68 @@
+/*
+ * Data generator for make bench
+ *
+ * Expects psql variable rows. Every benchmark reads from bench_data, which
+ * holds the same values as native types, as variants and as jsonb so that
+ * each variant path can be compared against both baselines.
+ */
+\set ON_ERROR_STOP true
+SET client_min_messages = warning;
+
+CREATE EXTENSION IF NOT EXISTS variant;
+
+SELECT variant.register( 'bench', '{int4,int8,text,uuid}', true )
+  WHERE NOT EXISTS( SELECT 1 FROM _variant._registered WHERE lower(variant_name) = 'bench' )
+;
+
+DROP TABLE IF EXISTS bench_data;
+CREATE TABLE bench_data(
+  id          int     NOT NULL PRIMARY KEY
+  -- Native baseline
+  , n_int     int
+  , n_big     bigint
+  , n_text    text
+  , n_uuid    uuid
+  -- Variant
+  , v_int     variant.variant(bench)
+  , v_big     variant.variant(bench)
+  , v_text    variant.variant(bench)
+  , v_uuid    variant.variant(bench)
+  -- jsonb baseline
+  , j_int     jsonb
+  , j_big     jsonb
+  , j_text    jsonb
+  , j_uuid    jsonb
+  -- Text input for the *_in benchmarks
+  , s_int     text
+  , s_v_int   text
+);
+
+INSERT INTO bench_data( id, n_int, n_big, n_text, n_uuid )
+  SELECT i
+      , (i * 7919) % :rows
+      , (i * 7919) % :rows
+      , md5(i::text) || repeat( 'x', i % 64 )
+      , md5(i::text)::uuid
+    FROM generate_series(1, :rows) i
+;
+UPDATE bench_data SET
+  v_int = n_int
+  , v_big = n_big
+  , v_text = n_text
+  , v_uuid = n_uuid
+  , j_int = to_jsonb(n_int)
+  , j_big = to_jsonb(n_big)
+  , j_text = to_jsonb(n_text)
+  , j_uuid = to_jsonb(n_uuid)
+  , s_int = n_int::text
+  , s_v_int = variant.text_out(n_int::variant.variant(bench))
+;
+VACUUM FREEZE ANALYZE bench_data;
+
+-- Targets for the COPY in benchmarks
+DROP TABLE IF EXISTS bench_copy_native, bench_copy_variant, bench_copy_jsonb;
+CREATE TABLE bench_copy_native( i int, t text, u uuid );
+CREATE TABLE bench_copy_variant( i variant.variant(bench), t variant.variant(bench), u variant.variant(bench) );
+CREATE TABLE bench_copy_jsonb( i jsonb, t jsonb, u jsonb );
+
+-- vi: expandtab sw=2 ts=2
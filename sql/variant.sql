@@ -68,6 +68,11 @@ RETURNS variant.variant LANGUAGE sql IMMUTABLE STRICT AS $f$
 SELECT variant.text_in( $1, -1 )
 $f$;
 
+-- See variant_expand() in variant.c
+CREATE OR REPLACE FUNCTION variant.expand(variant.variant)
+RETURNS variant.variant LANGUAGE c IMMUTABLE STRICT
+AS '$libdir/variant', 'variant_expand';
+
 CREATE OR REPLACE FUNCTION _variant.variant_hash(variant.variant)
 RETURNS int LANGUAGE c IMMUTABLE STRICT
 AS '$libdir/variant', 'variant_hash';
@@ -77,6 +82,51 @@ AS '$libdir/variant', 'quote_variant_name';
 CREATE OR REPLACE FUNCTION variant.original_type(variant.variant)
 RETURNS regtype LANGUAGE c IMMUTABLE STRICT
 AS '$libdir/variant', 'variant_type_out';
+-- So variant.type_census() can use a parallel scan
+DO $$
+BEGIN
+  IF current_setting('server_version_num')::int >= 90600 THEN
+    EXECUTE 'ALTER FUNCTION variant.original_type(variant.variant) PARALLEL SAFE';
+  END IF;
+END
+$$;
+
+/*
+ * Runtime statistics. cluster is only available if variant is in
+ * shared_preload_libraries.
+ */
+CREATE OR REPLACE FUNCTION _variant.stats(
+  p_shared boolean
+  , OUT stat_name text
+  , OUT value bigint
+) RETURNS SETOF record LANGUAGE c VOLATILE STRICT
+AS '$libdir/variant', 'variant_stats';
+CREATE OR REPLACE VIEW variant.stats AS
+  SELECT b.stat_name, b.value AS backend, c.value AS cluster
+    FROM _variant.stats(false) b
+      LEFT JOIN _variant.stats(true) c USING( stat_name )
+;
+GRANT SELECT ON variant.stats TO public;
+CREATE OR REPLACE FUNCTION _variant._stats_reset(
+  p_shared boolean
+) RETURNS void LANGUAGE c VOLATILE STRICT
+AS '$libdir/variant', 'variant_stats_reset';
+CREATE OR REPLACE FUNCTION variant.stats_reset(
+  p_shared boolean DEFAULT false
+) RETURNS void LANGUAGE sql AS $f$
+SELECT _variant._stats_reset( coalesce( p_shared, false ) )
+$f$;
+
+-- For testing only; see variant_bench() in variant.c
+CREATE OR REPLACE FUNCTION _variant.bench(
+  op text
+  , sample variant.variant
+  , iterations int
+  , OUT ns_per_op double precision
+  , OUT bytes_per_op double precision
+) LANGUAGE c VOLATILE STRICT
+AS '$libdir/variant', 'variant_bench';
+REVOKE ALL ON FUNCTION _variant.bench(text, variant.variant, int) FROM PUBLIC;
 
 SELECT NULL = count(*) FROM ( -- Supress tons of blank lines
 SELECT _variant.exec( format($$
@@ -85,8 +135,40 @@ CREATE OR REPLACE FUNCTION _variant.variant_%1$s(variant.variant, variant.varian
   $$
   , op
 ) )
-FROM unnest(string_to_array('image_eq lt le eq ne ge gt', ' ')) AS op
+FROM unnest(string_to_array('image_eq image_lt image_le image_ge image_gt lt le eq ne ge gt', ' ')) AS op
 ) a;
+CREATE OR REPLACE FUNCTION _variant.variant_image_cmp(variant.variant, variant.variant)
+RETURNS int LANGUAGE c IMMUTABLE STRICT
+AS '$libdir/variant', 'variant_image_cmp';
+
+-- "Is of type" tests; these only look at the variant header
+SELECT NULL = count(*) FROM ( -- Supress tons of blank lines
+SELECT _variant.exec( format($$
+CREATE OR REPLACE FUNCTION _variant.variant_type_%1$s(variant.variant, regtype)
+  RETURNS boolean LANGUAGE c IMMUTABLE STRICT AS '$libdir/variant', 'variant_type_%1$s';
+  $$
+  , op
+) )
+FROM unnest(string_to_array('lt le eq ne ge gt', ' ')) AS op
+) a;
+CREATE OR REPLACE FUNCTION _variant.variant_type_cmp(variant.variant, regtype)
+RETURNS int LANGUAGE c IMMUTABLE STRICT
+AS '$libdir/variant', 'variant_type_cmp';
+-- Lets partition pruning see @= tests; see variant_type_eq_support() in variant.c
+DO $do$
+BEGIN
+  IF current_setting('server_version_num')::int >= 120000 THEN
+    PERFORM _variant.exec( $sql$
+CREATE OR REPLACE FUNCTION _variant.variant_type_eq_support(internal)
+RETURNS internal LANGUAGE c IMMUTABLE STRICT
+AS '$libdir/variant', 'variant_type_eq_support'
+$sql$ );
+    PERFORM _variant.exec( $sql$
+ALTER FUNCTION _variant.variant_type_eq(variant.variant, regtype) SUPPORT _variant.variant_type_eq_support
+$sql$ );
+  END IF;
+END
+$do$;
 
 CREATE OPERATOR < (
   PROCEDURE = _variant.variant_lt
@@ -138,12 +220,136 @@ CREATE OPERATOR *= (
   -- TODO , NEGATOR = *!=
 );
 
+CREATE OPERATOR *< (
+  PROCEDURE = _variant.variant_image_lt
+  , LEFTARG = variant.variant
+  , RIGHTARG = variant.variant
+  , COMMUTATOR = *>
+  , NEGATOR = *>=
+);
+CREATE OPERATOR *<= (
+  PROCEDURE = _variant.variant_image_le
+  , LEFTARG = variant.variant
+  , RIGHTARG = variant.variant
+  , COMMUTATOR = *>=
+  , NEGATOR = *>
+);
+CREATE OPERATOR *>= (
+  PROCEDURE = _variant.variant_image_ge
+  , LEFTARG = variant.variant
+  , RIGHTARG = variant.variant
+  , COMMUTATOR = *<=
+  , NEGATOR = *<
+);
+CREATE OPERATOR *> (
+  PROCEDURE = _variant.variant_image_gt
+  , LEFTARG = variant.variant
+  , RIGHTARG = variant.variant
+  , COMMUTATOR = *<
+  , NEGATOR = *<=
+);
+
+/*
+ * "Is of type" operators: variant @= regtype is true when the original type
+ * of the variant is exactly regtype (typmod is ignored). The range variants
+ * compare type Oids, which is only useful for index range scans.
+ */
+CREATE OPERATOR @< (
+  PROCEDURE = _variant.variant_type_lt
+  , LEFTARG = variant.variant
+  , RIGHTARG = regtype
+  , NEGATOR = @>=
+  , RESTRICT = scalarltsel
+);
+CREATE OPERATOR @<= (
+  PROCEDURE = _variant.variant_type_le
+  , LEFTARG = variant.variant
+  , RIGHTARG = regtype
+  , NEGATOR = @>
+  , RESTRICT = scalarltsel
+);
+CREATE OPERATOR @= (
+  PROCEDURE = _variant.variant_type_eq
+  , LEFTARG = variant.variant
+  , RIGHTARG = regtype
+  , NEGATOR = @!=
+  , RESTRICT = eqsel
+);
+CREATE OPERATOR @!= (
+  PROCEDURE = _variant.variant_type_ne
+  , LEFTARG = variant.variant
+  , RIGHTARG = regtype
+  , NEGATOR = @=
+  , RESTRICT = neqsel
+);
+CREATE OPERATOR @>= (
+  PROCEDURE = _variant.variant_type_ge
+  , LEFTARG = variant.variant
+  , RIGHTARG = regtype
+  , NEGATOR = @<
+  , RESTRICT = scalargtsel
+);
+CREATE OPERATOR @> (
+  PROCEDURE = _variant.variant_type_gt
+  , LEFTARG = variant.variant
+  , RIGHTARG = regtype
+  , NEGATOR = @<=
+  , RESTRICT = scalargtsel
+);
+
 CREATE OPERATOR CLASS hash__variant_ops
   DEFAULT FOR TYPE variant.variant
   USING hash AS
     OPERATOR 1 *=
     , FUNCTION 1 _variant.variant_hash(variant.variant)
 ;
+-- Hash partitioning needs the extended hash function, which only exists in 11+
+DO $do$
+BEGIN
+  IF current_setting('server_version_num')::int >= 110000 THEN
+    PERFORM _variant.exec( $sql$
+CREATE OR REPLACE FUNCTION _variant.variant_hash_extended(variant.variant, bigint)
+RETURNS bigint LANGUAGE c IMMUTABLE STRICT
+AS '$libdir/variant', 'variant_hash_extended'
+$sql$ );
+    PERFORM _variant.exec( $sql$
+ALTER OPERATOR FAMILY hash__variant_ops USING hash ADD
+  FUNCTION 2 _variant.variant_hash_extended(variant.variant, bigint)
+$sql$ );
+  END IF;
+END
+$do$;
+
+/*
+ * Not the default because image ordering isn't meaningful to users. The point
+ * of this opclass is the cross-type members; an index using it can answer
+ * "is of type" tests without looking at anything but the type Oid prefix of
+ * each key, ie:
+ *
+ * CREATE INDEX ... ON setting( setting_value variant.btree__variant_type_ops );
+ * SELECT ... WHERE setting_value @= 'int4';
+ *
+ * A hash opclass for the type tests doesn't make sense: every variant of a
+ * given type would land in the same bucket.
+ */
+CREATE OPERATOR CLASS btree__variant_type_ops
+  FOR TYPE variant.variant
+  USING btree AS
+    OPERATOR 1 *<
+    , OPERATOR 2 *<=
+    , OPERATOR 3 *=
+    , OPERATOR 4 *>=
+    , OPERATOR 5 *>
+    , FUNCTION 1 _variant.variant_image_cmp(variant.variant, variant.variant)
+;
+ALTER OPERATOR FAMILY btree__variant_type_ops USING btree ADD
+  OPERATOR 1 @< (variant.variant, regtype)
+  , OPERATOR 2 @<= (variant.variant, regtype)
+  , OPERATOR 3 @= (variant.variant, regtype)
+  , OPERATOR 4 @>= (variant.variant, regtype)
+  , OPERATOR 5 @> (variant.variant, regtype)
+  , FUNCTION 1 _variant.variant_type_cmp(variant.variant, regtype)
+;
 
 CREATE OR REPLACE VIEW _variant.allowed_types AS
   SELECT t.oid::regtype AS type_name
@@ -209,88 +415,163 @@ CREATE OR REPLACE VIEW variant.missing_casts AS
     FROM _variant.missing_casts_out
 ;
 
-CREATE OR REPLACE FUNCTION _variant.create_cast_in(
+/*
+ * DDL to create a cast, as text. Generating the DDL separately lets
+ * _variant.create_casts() build a whole batch of casts with one query and run
+ * it with one EXECUTE.
+ */
+CREATE OR REPLACE FUNCTION _variant.cast_in_ddl(
   p_source    regtype
-) RETURNS void LANGUAGE plpgsql AS $f$
-BEGIN
-  PERFORM _variant.exec(
-    format(
+) RETURNS text LANGUAGE sql STABLE AS $f$
+SELECT format(
       $sql$CREATE OR REPLACE FUNCTION _variant.cast_in(
       i %s
       , typmod int
       , explicit boolean
-    ) RETURNS variant.variant LANGUAGE c IMMUTABLE AS '$libdir/variant', 'variant_cast_in'
-      $sql$
-      , p_source -- i data type
-    )
-  );
-  PERFORM _variant.exec(
-    format( 'CREATE CAST( %s AS variant.variant ) WITH FUNCTION _variant.cast_in( %1$s, int, boolean ) AS %s'
-      , p_source
-      , CASE (SELECT typcategory FROM pg_type WHERE oid = p_source) WHEN 'A' THEN 'ASSIGNMENT' ELSE 'IMPLICIT' END
+    ) RETURNS variant.variant LANGUAGE c IMMUTABLE AS '$libdir/variant', 'variant_cast_in';
+CREATE CAST( %1$s AS variant.variant ) WITH FUNCTION _variant.cast_in( %1$s, int, boolean ) AS %s;
+$sql$
+      , $1 -- i data type
+      , CASE (SELECT typcategory FROM pg_type WHERE oid = $1) WHEN 'A' THEN 'ASSIGNMENT' ELSE 'IMPLICIT' END
     )
-  );
-END
 $f$;
 
-CREATE OR REPLACE FUNCTION _variant.create_cast_out(
+CREATE OR REPLACE FUNCTION _variant.cast_out_function_name(
   p_target    regtype
-) RETURNS void LANGUAGE plpgsql AS $f$
-DECLARE
-  v_function_name name :=
-    'cast_to_'
+) RETURNS name LANGUAGE sql STABLE AS $f$
+SELECT ( 'cast_to_'
     || regexp_replace(
-          CASE WHEN p_target::text LIKE '%[]'
-            THEN '_' || regexp_replace( p_target::text, '\[]$', '' )
-          ELSE p_target::text
+          CASE WHEN $1::text LIKE '%[]'
+            THEN '_' || regexp_replace( $1::text, '\[]$', '' )
+          ELSE $1::text
           END
           , '[\. "]' -- Replace invarid identifier characters with '_'
           , '_'
           , 'g' -- Replace globally
         )
-  ;
-BEGIN
-  PERFORM _variant.exec(
-    format(
+  )::name
+$f$;
+
+CREATE OR REPLACE FUNCTION _variant.cast_out_ddl(
+  p_target    regtype
+) RETURNS text LANGUAGE sql STABLE AS $f$
+SELECT format(
       $sql$CREATE OR REPLACE FUNCTION _variant.%s(
       v variant.variant
-    ) RETURNS %1s LANGUAGE c IMMUTABLE AS '$libdir/variant', 'variant_cast_out'
-      $sql$
-      , v_function_name
-      , p_target
+    ) RETURNS %s LANGUAGE c IMMUTABLE AS '$libdir/variant', 'variant_cast_out';
+CREATE CAST( variant.variant AS %2$s ) WITH FUNCTION _variant.%1$s( variant.variant ) AS ASSIGNMENT;
+$sql$
+      , _variant.cast_out_function_name( $1 )
+      , $1
     )
-  );
-  PERFORM _variant.exec(
-    format( 'CREATE CAST( variant.variant AS %s) WITH FUNCTION _variant.%s( variant.variant ) AS ASSIGNMENT'
-      , p_target
-      , v_function_name
-    )
-  );
+$f$;
+
+CREATE OR REPLACE FUNCTION _variant.create_cast_in(
+  p_source    regtype
+) RETURNS void LANGUAGE plpgsql AS $f$
+BEGIN
+  PERFORM _variant.exec( _variant.cast_in_ddl( p_source ) );
 END
 $f$;
 
-CREATE OR REPLACE FUNCTION variant.create_casts()
-RETURNS void LANGUAGE plpgsql AS $f$
+CREATE OR REPLACE FUNCTION _variant.create_cast_out(
+  p_target    regtype
+) RETURNS void LANGUAGE plpgsql AS $f$
+BEGIN
+  PERFORM _variant.exec( _variant.cast_out_ddl( p_target ) );
+END
+$f$;
+
+CREATE OR REPLACE FUNCTION _variant.create_casts(
+  p_types       regtype[] -- NULL means all types
+  , p_batch_size  int DEFAULT 500
+) RETURNS int LANGUAGE plpgsql AS $f$
+/*
+ * Create missing casts for p_types, p_batch_size casts at a time. Returns the
+ * number of casts created.
+ */
 DECLARE
-  r variant.missing_casts;
-  sql text;
+  v_sql text;
+  v_batch_count int;
+  v_count int := 0;
 BEGIN
-  FOR r IN
-    SELECT * FROM variant.missing_casts
+  FOR v_sql, v_batch_count IN
+    SELECT string_agg( ddl, '' ), count(*)
+      FROM (
+        SELECT ddl, ( row_number() OVER () - 1 ) / p_batch_size AS batch
+          FROM (
+            SELECT _variant.cast_in_ddl( source )
+              FROM _variant.missing_casts_in
+              WHERE p_types IS NULL OR source = ANY( p_types )
+            UNION ALL
+            SELECT _variant.cast_out_ddl( target )
+              FROM _variant.missing_casts_out
+              WHERE p_types IS NULL OR target = ANY( p_types )
+          ) d(ddl)
+      ) b
+      GROUP BY batch
+      ORDER BY batch
   LOOP
-    IF r.direction = 'IN' THEN
-      PERFORM _variant.create_cast_in( r.source );
-    ELSIF r.direction = 'OUT' THEN
-      PERFORM _variant.create_cast_out( r.target );
-    ELSE
-      RAISE EXCEPTION 'Unknown cast direction "%"', r.direction;
-    END IF;
+    PERFORM _variant.exec( v_sql );
+    v_count := v_count + v_batch_count;
   END LOOP;
+
+  RETURN v_count;
 END
 $f$;
 
--- Automagically create casts for everything we support
-SELECT variant.create_casts();
+CREATE OR REPLACE FUNCTION variant.create_casts()
+RETURNS void LANGUAGE plpgsql AS $f$
+BEGIN
+  PERFORM _variant.create_casts( NULL );
+END
+$f$;
+
+CREATE OR REPLACE FUNCTION variant.create_casts(
+  p_types   regtype[]
+) RETURNS void LANGUAGE plpgsql AS $f$
+BEGIN
+  IF p_types IS NULL THEN
+    RAISE EXCEPTION 'p_types may not be NULL'
+      USING HINT = 'Use variant.create_casts() to create all casts'
+    ;
+  END IF;
+  PERFORM _variant.create_casts( p_types );
+END
+$f$;
+
+/*
+ * Automagically create casts for everything we support. On databases with a
+ * lot of types that takes a while and adds two functions per type, so
+ * variant.install_casts can be set before CREATE EXTENSION to change that:
+ *
+ *   all (the default)    casts for every type
+ *   none                 no casts until they're needed
+ *   a list of types      just those, ie: 'int4, text, uuid'
+ *
+ * Either way, casts for a registered variant's allowed types are created when
+ * the types are added to it.
+ */
+DO $do$
+DECLARE
+  v_mode text;
+BEGIN
+  BEGIN
+    v_mode := trim( current_setting( 'variant.install_casts' ) );
+  EXCEPTION
+    WHEN undefined_object THEN
+      v_mode := NULL;
+  END;
+
+  IF lower( coalesce( v_mode, '' ) ) IN ( '', 'all' ) THEN
+    PERFORM _variant.create_casts( NULL );
+  ELSIF lower( v_mode ) != 'none' THEN
+    PERFORM _variant.create_casts(
+      array( SELECT trim(t)::regtype FROM unnest( string_to_array( v_mode, ',' ) ) t )
+    );
+  END IF;
+END
+$do$;
 
 CREATE TABLE _variant._registered(
   variant_typmod    SERIAL        PRIMARY KEY
@@ -305,8 +586,20 @@ CREATE TABLE _variant._registered(
        * idea, this is required by _variant._tg_check_type_usage.
        */
       CHECK( allowed_types = array_remove(allowed_types, NULL) )
+  , dynamic         boolean       NOT NULL DEFAULT false
+  , intern_threshold int
+      CONSTRAINT intern_threshold_minimum_value CHECK( intern_threshold >= 64 )
+  , fixed_type      regtype
   , CONSTRAINT storing_default_variant_not_supported
       CHECK( variant_typmod >= 0 OR NOT storage_allowed )
+  , CONSTRAINT dynamic_default_variant_not_supported
+      CHECK( variant_typmod >= 0 OR NOT dynamic )
+  , CONSTRAINT interning_default_variant_not_supported
+      CHECK( variant_typmod >= 0 OR intern_threshold IS NULL )
+  , CONSTRAINT fixed_type_default_variant_not_supported
+      CHECK( variant_typmod >= 0 OR fixed_type IS NULL )
+  , CONSTRAINT fixed_type_may_not_be_interned
+      CHECK( fixed_type IS NULL OR intern_threshold IS NULL )
 );
 CREATE UNIQUE INDEX _registered__u_lcase_variant_name ON _variant._registered( lower( variant_name ) );
 CREATE UNIQUE INDEX _registered__u_quote_variant_name ON _variant._registered( _variant.quote_variant_name( variant_name ) );
@@ -317,6 +610,48 @@ INSERT INTO _variant._registered VALUES( -1, 'DEFAULT', true, false, '{}' );
 CREATE VIEW variant._registered AS SELECT * FROM _variant._registered;
 GRANT SELECT ON variant._registered TO public;
 
+/*
+ * Large payloads of registered variants with an intern_threshold are stored
+ * here once, keyed by their SHA-256; see variant_intern() in variant.c. Rows
+ * are never removed, since we can't tell what's still referenced without
+ * looking at every variant column.
+ */
+CREATE TABLE _variant._interned(
+  digest    bytea   PRIMARY KEY
+  , payload bytea   NOT NULL
+);
+/*
+ * Both of these are only called from C, as the extension owner. _intern()
+ * computes the digest itself so nobody can store a payload under someone
+ * else's digest.
+ *
+ * Interning needs sha256(), which only exists in 11+
+ */
+DO $do$
+BEGIN
+  IF current_setting('server_version_num')::int >= 110000 THEN
+    PERFORM _variant.exec( $sql$
+CREATE OR REPLACE FUNCTION variant._intern(
+  p_payload _variant._interned.payload%TYPE
+) RETURNS void SECURITY DEFINER SET search_path = pg_catalog, pg_temp LANGUAGE sql AS $f$
+INSERT INTO _variant._interned VALUES( sha256($1), $1 ) ON CONFLICT DO NOTHING
+$f$;
+REVOKE ALL ON FUNCTION variant._intern(bytea) FROM PUBLIC;
+$sql$ );
+  END IF;
+END
+$do$;
+CREATE OR REPLACE FUNCTION variant._interned_payload(
+  p_digest _variant._interned.digest%TYPE
+) RETURNS _variant._interned.payload%TYPE SECURITY DEFINER SET search_path = pg_catalog, pg_temp LANGUAGE sql STABLE AS $f$
+SELECT payload FROM _variant._interned WHERE digest = $1
+$f$;
+REVOKE ALL ON FUNCTION variant._interned_payload(bytea) FROM PUBLIC;
+
+-- Add to tables with interned variant columns; see variant.intern_threshold()
+CREATE OR REPLACE FUNCTION variant.intern()
+RETURNS trigger LANGUAGE c AS '$libdir/variant', 'variant_intern_trigger';
+
 CREATE VIEW variant.registered AS
   SELECT variant_typmod, _variant.quote_variant_name(variant_name), variant_enabled, storage_allowed, coalesce( array_length(allowed_types, 1), 0 ) AS types_allowed
     FROM _variant._registered
@@ -346,14 +681,221 @@ CREATE VIEW variant.stored__bad AS
             OR NOT variant_enabled
 ;
 
+/*
+ * Row count and total size of each type stored in a variant column. Only the
+ * variant header of each value is read, so this doesn't need to detoast the
+ * values themselves.
+ *
+ * p_sample_percent reads only that percent of the table (TABLESAMPLE SYSTEM;
+ * 9.5+), and scales row_count and bytes up to estimates for the whole table.
+ * p_parallel allows a parallel scan of the table (9.6+).
+ */
+CREATE OR REPLACE FUNCTION variant.type_census(
+  p_table regclass
+  , p_column name
+  , p_sample_percent float8 DEFAULT NULL -- NULL means read the whole table
+  , p_parallel boolean DEFAULT false
+) RETURNS TABLE(
+  original_type regtype
+  , row_count bigint
+  , bytes bigint
+) LANGUAGE plpgsql AS $f$
+DECLARE
+  c_version CONSTANT int := current_setting('server_version_num');
+  c_parallel_settings CONSTANT text[] := '{parallel_setup_cost,parallel_tuple_cost}';
+
+  v_old_settings text[];
+  v_sample text := '';
+  v_scale float8 := 1;
+  v_sql text;
+BEGIN
+  IF NOT EXISTS( SELECT 1
+        FROM pg_catalog.pg_attribute
+        WHERE attrelid = p_table
+          AND attname = p_column
+          AND atttypid = 'variant.variant'::regtype
+          AND NOT attisdropped
+      )
+  THEN
+    RAISE EXCEPTION 'column "%" of relation "%" is not a variant', p_column, p_table
+      USING ERRCODE = 'invalid_parameter_value'
+    ;
+  END IF;
+
+  IF p_sample_percent IS NOT NULL THEN
+    IF c_version < 90500 THEN
+      RAISE EXCEPTION 'sampling requires PostgreSQL 9.5 or newer'
+        USING ERRCODE = 'feature_not_supported'
+      ;
+    END IF;
+    IF p_sample_percent <= 0 OR p_sample_percent > 100 THEN
+      RAISE EXCEPTION 'sample percent must be greater than 0 and at most 100'
+        USING ERRCODE = 'invalid_parameter_value'
+      ;
+    END IF;
+    v_sample := format( 'TABLESAMPLE SYSTEM (%s)', p_sample_percent );
+    v_scale := 100 / p_sample_percent;
+  END IF;
+
+  IF p_parallel THEN
+    IF c_version < 90600 THEN
+      RAISE EXCEPTION 'parallel scans require PostgreSQL 9.6 or newer'
+        USING ERRCODE = 'feature_not_supported'
+      ;
+    END IF;
+    -- Make a parallel plan as attractive as possible, just for this query
+    v_old_settings := array( SELECT current_setting(s) FROM unnest( c_parallel_settings ) s );
+    PERFORM set_config( s, '0', true ) FROM unnest( c_parallel_settings ) s;
+  END IF;
+
+  v_sql := format(
+    $sql$SELECT t, round( c * $1 )::bigint, round( b * $1 )::bigint
+  FROM (
+    SELECT variant.original_type( %1$I ) AS t, count(*) AS c, sum( pg_column_size( %1$I ) ) AS b
+      FROM %2$s %3$s
+      WHERE %1$I IS NOT NULL
+      GROUP BY 1
+  ) s
+  ORDER BY t
+$sql$
+    , p_column
+    , p_table
+    , v_sample
+  );
+  RETURN QUERY EXECUTE v_sql USING v_scale;
+
+  IF p_parallel THEN
+    PERFORM set_config( c_parallel_settings[i], v_old_settings[i], true )
+      FROM generate_subscripts( c_parallel_settings, 1 ) i
+    ;
+  END IF;
+END
+$f$;
+
+/*
+ * Storage overhead. See variant_storage_info() in variant.c for what the
+ * numbers mean.
+ */
+CREATE OR REPLACE FUNCTION _variant.storage_info(
+  v variant.variant
+  , OUT original_type regtype
+  , OUT header_bytes int
+  , OUT overflow_bytes int
+  , OUT padding_bytes int
+  , OUT payload_bytes int
+  , OUT raw_bytes int
+  , OUT stored_bytes int
+  , OUT is_external boolean
+  , OUT is_compressed boolean
+) LANGUAGE c IMMUTABLE STRICT
+AS '$libdir/variant', 'variant_storage_info';
+
+CREATE OR REPLACE FUNCTION variant.storage_stats(
+  p_table regclass
+) RETURNS TABLE(
+  column_name name
+  , original_type regtype
+  , row_count bigint
+  , header_bytes bigint
+  , overflow_bytes bigint
+  , padding_bytes bigint
+  , payload_bytes bigint
+  , raw_bytes bigint
+  , stored_bytes bigint
+  , inline_count bigint
+  , external_count bigint
+  , compressed_count bigint
+  , compression_ratio numeric
+) LANGUAGE plpgsql AS $f$
+DECLARE
+  v_column name;
+BEGIN
+  FOR v_column IN
+    SELECT attname FROM _variant.stored WHERE attrelid = p_table ORDER BY attnum
+  LOOP
+    RETURN QUERY EXECUTE format(
+      $sql$SELECT %1$L::name, i.original_type, count(*)
+    , sum( i.header_bytes )::bigint
+    , sum( i.overflow_bytes )::bigint
+    , sum( i.padding_bytes )::bigint
+    , sum( i.payload_bytes )::bigint
+    , sum( i.raw_bytes )::bigint
+    , sum( i.stored_bytes )::bigint
+    , sum( CASE WHEN i.is_external THEN 0 ELSE 1 END )::bigint
+    , sum( CASE WHEN i.is_external THEN 1 ELSE 0 END )::bigint
+    , sum( CASE WHEN i.is_compressed THEN 1 ELSE 0 END )::bigint
+    , round( sum( i.raw_bytes )::numeric / nullif( sum( i.stored_bytes ), 0 ), 2 )
+  FROM %2$s t, _variant.storage_info( t.%1$I ) i
+  GROUP BY i.original_type
+  ORDER BY i.original_type
+$sql$
+      , v_column
+      , p_table
+    );
+  END LOOP;
+END
+$f$;
+
+CREATE OR REPLACE VIEW variant.storage_stats_all AS
+  SELECT t.table_name, s.*
+    FROM (
+        SELECT r.oid::regclass AS table_name
+          FROM pg_catalog.pg_class r
+          WHERE r.oid IN ( SELECT attrelid FROM _variant.stored )
+            AND r.relkind IN ( 'r', 'm', 'p' )
+            AND NOT pg_is_other_temp_schema( r.relnamespace )
+          OFFSET 0 -- Make sure we filter before calling storage_stats()
+      ) t
+      , variant.storage_stats( t.table_name ) s
+;
+
+/*
+ * Does a variant column contain any values of p_types?
+ */
+CREATE OR REPLACE FUNCTION _variant._column_has_types(
+  p_table regclass
+  , p_column name
+  , p_types regtype[]
+) RETURNS boolean LANGUAGE plpgsql AS $f$
+DECLARE
+  v_relkind "char";
+  v_other_temp boolean;
+BEGIN
+  SELECT relkind, pg_is_other_temp_schema( relnamespace )
+    INTO STRICT v_relkind, v_other_temp
+    FROM pg_catalog.pg_class
+    WHERE oid = p_table
+  ;
+
+  -- Index data is always in a table that we'll also check
+  IF v_relkind = 'i' THEN
+    RETURN false;
+  END IF;
+
+  -- We can't look at other backends' temp tables, or inside composite types
+  IF v_other_temp OR v_relkind NOT IN ( 'r', 'p', 'm' ) THEN
+    RETURN true;
+  END IF;
+
+  -- Keep anyone from adding more values until we're done
+  IF v_relkind IN ( 'r', 'p' ) THEN
+    PERFORM _variant.exec( format( 'LOCK TABLE %s IN SHARE MODE', p_table ) );
+  END IF;
+
+  RETURN EXISTS( SELECT 1
+      FROM variant.type_census( p_table, p_column, p_parallel := current_setting('server_version_num')::int >= 90600 )
+      WHERE original_type = ANY( p_types )
+  );
+END
+$f$;
+
 CREATE OR REPLACE FUNCTION _variant._tg_check_type_usage(
 ) RETURNS trigger LANGUAGE plpgsql AS $f$
 /*
  * Verify that if we're removing a type from the list of allowed types that
- * this registered variant isn't being used in a table anywhere.
- *
- * TODO: We should have a way to verify that a table doesn't contain any rows
- * with a particular type.
+ * no table is storing that type in this registered variant. If we're
+ * disabling storage or deleting the variant it can't be used in any table at
+ * all.
  */
 DECLARE
   v_columns text[];
@@ -382,12 +924,30 @@ BEGIN
     END IF;
   END IF;
 
+  /*
+   * Compact values of a fixed type variant can't be read without its
+   * registration, and they don't have to be in a column that uses it (they
+   * can be in an array or a DEFAULT variant, for example), so we can't tell
+   * if it's still in use.
+   */
+  IF TG_OP = 'DELETE' AND OLD.fixed_type IS NOT NULL THEN
+    RAISE EXCEPTION 'Deleting a fixed type variant is not allowed'
+      USING ERRCODE = 'invalid_parameter_value'
+    ;
+  END IF;
+
   IF TG_OP = 'UPDATE' THEN
     IF NEW.variant_typmod IS DISTINCT FROM OLD.variant_typmod THEN
       RAISE EXCEPTION 'Changing variant typmods is not allowed'
         USING ERRCODE = 'invalid_parameter_value'
       ;
     END IF;
+    -- Stored values of a fixed type variant only make sense with the same fixed_type
+    IF NEW.fixed_type IS DISTINCT FROM OLD.fixed_type THEN
+      RAISE EXCEPTION 'Changing the fixed type of a variant is not allowed'
+        USING ERRCODE = 'invalid_parameter_value'
+      ;
+    END IF;
 
     IF NEW.allowed_types @> OLD.allowed_types
       AND NEW.storage_allowed
@@ -402,7 +962,19 @@ BEGIN
     v_new_types := '{}';
   END IF;
 
-  v_columns := columns_using_variant FROM variant.stored WHERE variant_typmod = OLD.variant_typmod;
+  IF TG_OP = 'UPDATE' AND v_new_storage THEN
+    -- Only removing types, so only columns that contain those types matter
+    v_columns := array(
+      SELECT attrelid::regclass || '.' || column_name
+        FROM _variant.stored
+        WHERE variant_typmod = OLD.variant_typmod
+          AND _variant._column_has_types( attrelid, attname
+              , array( SELECT unnest( OLD.allowed_types ) EXCEPT SELECT unnest( v_new_types ) )
+            )
+    );
+  ELSE
+    v_columns := columns_using_variant FROM variant.stored WHERE variant_typmod = OLD.variant_typmod;
+  END IF;
   RAISE DEBUG 'TG_OP: %, OLD.allowed_types %, NEW.allowed_types %, OLD.storage_allowed %, NEW.storage_allowed %, v_columns %'
     , TG_WHEN
     , OLD.allowed_types
@@ -427,6 +999,16 @@ CREATE TRIGGER check_type_usage
   EXECUTE PROCEDURE _variant._tg_check_type_usage()
 ;
 
+-- Backends cache _variant._registered; see registry_lookup() in variant.c
+CREATE OR REPLACE FUNCTION _variant._tg_registered_inval(
+) RETURNS trigger LANGUAGE c
+AS '$libdir/variant', 'variant_registered_inval';
+CREATE TRIGGER registered_inval
+  AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON _variant._registered
+  FOR EACH STATEMENT
+  EXECUTE PROCEDURE _variant._tg_registered_inval()
+;
+
 CREATE OR REPLACE FUNCTION _variant.stored__bad(
 ) RETURNS text[] LANGUAGE sql AS $body$
 SELECT array(
@@ -437,13 +1019,49 @@ $body$;
 
 /*
  * WARNING: This function is called from a SECDEF trigger!
+ *
+ * If p_relids is given only those relations (and their inheritance children)
+ * are checked, which is what keeps DDL fast on databases with a lot of
+ * columns.
  */
 CREATE OR REPLACE FUNCTION _variant._verify_storage(
   p_fix_it boolean
+  , p_relids oid[] DEFAULT NULL -- NULL means all relations
 ) RETURNS void LANGUAGE plpgsql AS $body$
 DECLARE
-  v_bad CONSTANT text[] := _variant.stored__bad();
+  v_relids oid[];
+  v_bad text[];
 BEGIN
+  IF p_relids IS NULL THEN
+    v_bad := _variant.stored__bad();
+  ELSE
+    -- ALTER TABLE recurses to children, but only reports the parent
+    v_relids := array(
+      WITH RECURSIVE rels(relid) AS (
+          SELECT unnest( p_relids )
+        UNION
+          SELECT inhrelid FROM pg_catalog.pg_inherits JOIN rels ON inhparent = relid
+      )
+      SELECT relid FROM rels
+    );
+
+    IF NOT EXISTS( SELECT 1
+          FROM pg_catalog.pg_attribute
+          WHERE attrelid = ANY( v_relids )
+            AND atttypid = 'variant.variant'::regtype
+            AND NOT attisdropped
+        )
+    THEN
+      RETURN;
+    END IF;
+
+    v_bad := array(
+      SELECT table_name || '.' || column_name || ' ' || type_name
+        FROM variant.stored__bad
+        WHERE table_name::oid = ANY( v_relids )
+    );
+  END IF;
+
   IF v_bad IS DISTINCT FROM '{}' THEN
     IF p_fix_it THEN
       UPDATE _variant._registered
@@ -467,16 +1085,37 @@ BEGIN
   END IF;
 END
 $body$;
+
+/*
+ * On 9.5 and up the end trigger only checks the relations the command
+ * touched. Domains don't matter since _variant.stored only looks at columns
+ * that are actually variants.
+ *
+ * The start trigger's full check exists to fix up anything that was broken
+ * before this command ran. That can only happen if the event triggers were
+ * missing or disabled, and _variant._ensure_storage_check() already fixes
+ * everything when it puts them back, so on 9.5+ it doesn't do anything.
+ */
 CREATE OR REPLACE FUNCTION variant._etg_verify_storage_start(
 ) RETURNS event_trigger SECURITY DEFINER LANGUAGE plpgsql AS $body$
 BEGIN
-  PERFORM _variant._verify_storage( true );
+  IF current_setting('server_version_num')::int < 90500 THEN
+    PERFORM _variant._verify_storage( true );
+  END IF;
 END
 $body$;
 CREATE OR REPLACE FUNCTION variant._etg_verify_storage_end(
 ) RETURNS event_trigger SECURITY DEFINER LANGUAGE plpgsql AS $body$
 BEGIN
-  PERFORM _variant._verify_storage( false );
+  IF current_setting('server_version_num')::int < 90500 THEN
+    PERFORM _variant._verify_storage( false );
+  ELSE
+    PERFORM _variant._verify_storage( false, array(
+        SELECT objid
+          FROM pg_event_trigger_ddl_commands()
+          WHERE classid = 'pg_catalog.pg_class'::regclass
+      ) );
+  END IF;
 END
 $body$;
 
@@ -543,12 +1182,19 @@ CREATE OR REPLACE FUNCTION variant.register(
   p_variant_name _variant._registered.variant_name%TYPE
   , p_allowed_types _variant._registered.allowed_types%TYPE DEFAULT '{}'
   , p_storage_allowed _variant._registered.storage_allowed%TYPE DEFAULT NULL
+  , p_dynamic _variant._registered.dynamic%TYPE DEFAULT false
+  , p_fixed_type _variant._registered.fixed_type%TYPE DEFAULT NULL
 ) RETURNS _variant._registered.variant_typmod%TYPE
 LANGUAGE plpgsql AS $func$
 DECLARE
   c_test_table CONSTANT text := 'test_ability_to_create_table_with_just_registered_variant';
 
   v_storage_allowed CONSTANT _variant._registered.storage_allowed%TYPE := coalesce( p_storage_allowed, false );
+  -- The fixed type is always allowed
+  v_allowed_types CONSTANT _variant._registered.allowed_types%TYPE := CASE
+      WHEN p_fixed_type IS NULL OR p_fixed_type = ANY( p_allowed_types ) THEN p_allowed_types
+      ELSE p_allowed_types || p_fixed_type
+    END;
   v_formatted_type text;
   ret _variant._registered.variant_typmod%TYPE;
 BEGIN
@@ -561,11 +1207,12 @@ BEGIN
     RAISE EXCEPTION 'variant_name may not be an empty string';
   END IF;
 
-  INSERT INTO _variant._registered( variant_name, storage_allowed, allowed_types )
-    VALUES( p_variant_name, true, p_allowed_types )
+  INSERT INTO _variant._registered( variant_name, storage_allowed, allowed_types, dynamic, fixed_type )
+    VALUES( p_variant_name, true, v_allowed_types, coalesce( p_dynamic, false ), p_fixed_type )
     RETURNING variant_typmod
     INTO ret
   ;
+  PERFORM _variant.create_casts( v_allowed_types );
   v_formatted_type := pg_catalog.format_type( 'variant.variant'::regtype, ret );
 
   -- This ensures that the user can actually use the variant that they're registering
@@ -673,6 +1320,111 @@ RETURNS variant.variant LANGUAGE sql IMMUTABLE STRICT AS $f$
 SELECT variant.text_in( $1, variant._registered__get__typmod($2) )
 $f$;
 
+/*
+ * jsonb conversion; see variant_to_jsonb() in variant.c. jsonb only exists in
+ * 9.4 and up.
+ */
+DO $do$
+BEGIN
+  IF current_setting('server_version_num')::int >= 90400 THEN
+    PERFORM _variant.exec( $sql$
+CREATE OR REPLACE FUNCTION variant.to_jsonb(variant.variant)
+RETURNS jsonb LANGUAGE c IMMUTABLE STRICT
+AS '$libdir/variant', 'variant_to_jsonb'
+$sql$ );
+    PERFORM _variant.exec( $sql$
+CREATE OR REPLACE FUNCTION variant.from_jsonb(jsonb, int)
+RETURNS variant.variant LANGUAGE c IMMUTABLE STRICT
+AS '$libdir/variant', 'variant_from_jsonb'
+$sql$ );
+    PERFORM _variant.exec( $sql$
+CREATE OR REPLACE FUNCTION variant.from_jsonb(jsonb, text)
+RETURNS variant.variant LANGUAGE sql IMMUTABLE STRICT AS $f$
+SELECT variant.from_jsonb( $1, variant._registered__get__typmod($2) )
+$f$
+$sql$ );
+    PERFORM _variant.exec( $sql$
+CREATE OR REPLACE FUNCTION variant.from_jsonb(jsonb)
+RETURNS variant.variant LANGUAGE sql IMMUTABLE STRICT AS $f$
+SELECT variant.from_jsonb( $1, -1 )
+$f$
+$sql$ );
+  END IF;
+END
+$do$;
+
+/*
+ * CBOR conversion; see variant_to_cbor() in variant.c.
+ */
+CREATE OR REPLACE FUNCTION variant.to_cbor(variant.variant)
+RETURNS bytea LANGUAGE c IMMUTABLE STRICT
+AS '$libdir/variant', 'variant_to_cbor';
+CREATE OR REPLACE FUNCTION variant.to_cbor(variant.variant[])
+RETURNS bytea LANGUAGE c IMMUTABLE STRICT
+AS '$libdir/variant', 'variant_array_to_cbor';
+
+CREATE OR REPLACE FUNCTION _variant.cbor_agg_transfn(internal, variant.variant)
+RETURNS internal LANGUAGE c IMMUTABLE
+AS '$libdir/variant', 'variant_cbor_agg_transfn';
+CREATE OR REPLACE FUNCTION _variant.cbor_agg_finalfn(internal)
+RETURNS bytea LANGUAGE c IMMUTABLE
+AS '$libdir/variant', 'variant_cbor_agg_finalfn';
+CREATE AGGREGATE variant.cbor_agg(variant.variant)(
+  SFUNC = _variant.cbor_agg_transfn
+  , STYPE = internal
+  , FINALFUNC = _variant.cbor_agg_finalfn
+);
+
+CREATE OR REPLACE FUNCTION variant.from_cbor(bytea, int)
+RETURNS variant.variant LANGUAGE c IMMUTABLE STRICT
+AS '$libdir/variant', 'variant_from_cbor';
+CREATE OR REPLACE FUNCTION variant.from_cbor(bytea, text)
+RETURNS variant.variant LANGUAGE sql IMMUTABLE STRICT AS $f$
+SELECT variant.from_cbor( $1, variant._registered__get__typmod($2) )
+$f$;
+CREATE OR REPLACE FUNCTION variant.from_cbor(bytea)
+RETURNS variant.variant LANGUAGE sql IMMUTABLE STRICT AS $f$
+SELECT variant.from_cbor( $1, -1 )
+$f$;
+
+CREATE OR REPLACE FUNCTION variant.from_cbor_array(bytea, int)
+RETURNS variant.variant[] LANGUAGE c IMMUTABLE STRICT
+AS '$libdir/variant', 'variant_array_from_cbor';
+CREATE OR REPLACE FUNCTION variant.from_cbor_array(bytea, text)
+RETURNS variant.variant[] LANGUAGE sql IMMUTABLE STRICT AS $f$
+SELECT variant.from_cbor_array( $1, variant._registered__get__typmod($2) )
+$f$;
+CREATE OR REPLACE FUNCTION variant.from_cbor_array(bytea)
+RETURNS variant.variant[] LANGUAGE sql IMMUTABLE STRICT AS $f$
+SELECT variant.from_cbor_array( $1, -1 )
+$f$;
+
+/*
+ * Build variants from parallel value and type arrays; see
+ * variant_from_text_array() in variant.c.
+ */
+CREATE OR REPLACE FUNCTION variant.from_text_array(text[], regtype[], int)
+RETURNS variant.variant[] LANGUAGE c IMMUTABLE STRICT
+AS '$libdir/variant', 'variant_from_text_array';
+CREATE OR REPLACE FUNCTION variant.from_text_array(text[], regtype[], text)
+RETURNS variant.variant[] LANGUAGE sql IMMUTABLE STRICT AS $f$
+SELECT variant.from_text_array( $1, $2, variant._registered__get__typmod($3) )
+$f$;
+CREATE OR REPLACE FUNCTION variant.from_text_array(text[], regtype[])
+RETURNS variant.variant[] LANGUAGE sql IMMUTABLE STRICT AS $f$
+SELECT variant.from_text_array( $1, $2, -1 )
+$f$;
+
+/*
+ * Order preserving keys; see variant_sort_key() in variant.c.
+ */
+CREATE OR REPLACE FUNCTION variant.sort_key(variant.variant)
+RETURNS bytea LANGUAGE c IMMUTABLE STRICT
+AS '$libdir/variant', 'variant_sort_key';
+CREATE OR REPLACE FUNCTION variant.sort_key(variant.variant, prefix_length int)
+RETURNS bytea LANGUAGE c IMMUTABLE STRICT
+AS '$libdir/variant', 'variant_sort_key';
+
 CREATE OR REPLACE FUNCTION variant.storage_allowed(
   p_variant_name _variant._registered.variant_name%TYPE
   , p_storage_allowed _variant._registered.storage_allowed%TYPE
@@ -696,6 +1448,113 @@ BEGIN
 END
 $body$;
 
+/*
+ * Dynamic variants add any type they're handed to allowed_types, instead of
+ * throwing an error. See approval_record() in variant.c.
+ */
+CREATE OR REPLACE FUNCTION variant.dynamic(
+  p_variant_name _variant._registered.variant_name%TYPE
+  , p_dynamic _variant._registered.dynamic%TYPE
+) RETURNS void LANGUAGE plpgsql AS $body$
+DECLARE
+  v_typmod CONSTANT _variant._registered.variant_typmod%TYPE := _variant.registered__get__typmod( p_variant_name );
+BEGIN
+  IF v_typmod = -1 AND p_dynamic THEN
+    RAISE EXCEPTION 'Making the DEFAULT variant dynamic is not allowed'
+      USING ERRCODE = 'invalid_parameter_value'
+    ;
+  END IF;
+
+  UPDATE _variant._registered
+    SET dynamic = p_dynamic
+    WHERE variant_typmod = v_typmod
+      AND dynamic IS DISTINCT FROM p_dynamic
+  ;
+END
+$body$;
+
+/*
+ * Payloads of at least p_intern_threshold bytes are stored once in
+ * _variant._interned instead of in every row of tables with a variant.intern()
+ * trigger. NULL turns interning off; existing references keep working.
+ */
+CREATE OR REPLACE FUNCTION variant.intern_threshold(
+  p_variant_name _variant._registered.variant_name%TYPE
+  , p_intern_threshold _variant._registered.intern_threshold%TYPE
+) RETURNS void LANGUAGE plpgsql AS $body$
+DECLARE
+  v_typmod CONSTANT _variant._registered.variant_typmod%TYPE := _variant.registered__get__typmod( p_variant_name );
+BEGIN
+  IF p_intern_threshold IS NOT NULL THEN
+    IF current_setting('server_version_num')::int < 110000 THEN
+      RAISE EXCEPTION 'interning variant payloads requires PostgreSQL 11 or newer'
+        USING ERRCODE = 'feature_not_supported'
+      ;
+    END IF;
+    IF v_typmod = -1 THEN
+      RAISE EXCEPTION 'Interning payloads of the DEFAULT variant is not allowed'
+        USING ERRCODE = 'invalid_parameter_value'
+      ;
+    END IF;
+  END IF;
+
+  UPDATE _variant._registered
+    SET intern_threshold = p_intern_threshold
+    WHERE variant_typmod = v_typmod
+      AND intern_threshold IS DISTINCT FROM p_intern_threshold
+  ;
+END
+$body$;
+
+/*
+ * Called at commit with the types a dynamic variant approved during the
+ * transaction. Types are only ever added, so _tg_check_type_usage() doesn't
+ * need to look at any tables. If the variant stopped being dynamic since the
+ * types were approved then values of those types may be about to be stored,
+ * so that's an error.
+ */
+CREATE OR REPLACE FUNCTION _variant.approve_types(
+  p_variant_typmod _variant._registered.variant_typmod%TYPE
+  , p_types _variant._registered.allowed_types%TYPE
+) RETURNS void LANGUAGE plpgsql AS $body$
+DECLARE
+  r_variant _variant._registered%ROWTYPE;
+BEGIN
+  UPDATE _variant._registered
+    SET allowed_types = allowed_types || array(
+        SELECT * FROM unnest( p_types )
+        EXCEPT
+        SELECT * FROM unnest( allowed_types )
+      )
+    WHERE variant_typmod = p_variant_typmod
+      AND dynamic
+      AND NOT allowed_types @> p_types
+  ;
+  IF FOUND THEN
+    PERFORM _variant.create_casts( p_types );
+    RETURN;
+  END IF;
+
+  r_variant := _variant.registered__get( p_variant_typmod );
+  IF NOT r_variant.allowed_types @> p_types THEN
+    RAISE EXCEPTION 'type % is not allowed in variant.variant(%)'
+        , array_to_string( array( SELECT * FROM unnest( p_types ) EXCEPT SELECT * FROM unnest( r_variant.allowed_types ) ), ', ' )
+        , _variant.quote_variant_name( r_variant.variant_name )
+      USING ERRCODE = 'invalid_parameter_value'
+        , DETAIL = 'The variant is no longer dynamic.'
+    ;
+  END IF;
+END
+$body$;
+-- Only called from C, as the extension owner
+CREATE OR REPLACE FUNCTION variant._approve_types(
+  _variant._registered.variant_typmod%TYPE
+  , _variant._registered.allowed_types%TYPE
+) RETURNS void SECURITY DEFINER SET search_path = pg_catalog, pg_temp LANGUAGE sql AS $f$
+SELECT _variant.approve_types($1, $2)
+$f$;
+REVOKE ALL ON FUNCTION variant._approve_types(int, regtype[]) FROM PUBLIC;
+
 CREATE OR REPLACE FUNCTION variant.allowed_types(
   p_variant_name _variant._registered.variant_name%TYPE
 ) RETURNS TABLE(allowed_type regtype) LANGUAGE sql STABLE AS $f$
@@ -731,6 +1590,7 @@ BEGIN
     WHERE variant_typmod = v_current.variant_typmod
     RETURNING allowed_types INTO v_new_allowed
   ;
+  PERFORM _variant.create_casts( p_allowed_types );
   RETURN QUERY SELECT t FROM unnest(v_new_allowed) t(t) ORDER BY t::text;
 END
 $f$;
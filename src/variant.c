@@ -12,10 +12,14 @@
  */
 
 #include "variant.h"
+#include <math.h>
 #include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
 #include "lib/stringinfo.h"
 #include "access/hash.h"
 #include "access/htup_details.h"
+#include "access/xact.h"
 #include "nodes/nodeFuncs.h"
 #include "parser/parse_type.h"
 #include "utils/builtins.h"
@@ -25,8 +29,60 @@
 #include "executor/spi.h"
 #include "utils/typcache.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/resowner.h"
+#if PG_VERSION_NUM >= 90500
+#include "utils/expandeddatum.h"
+#endif
 #include "catalog/pg_type.h"
+#include "portability/instr_time.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/syscache.h"
+#include "access/transam.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_class.h"
+#include "commands/extension.h"
+#include "commands/trigger.h"
+#include "utils/inval.h"
+#if PG_VERSION_NUM >= 90600
+#include "access/parallel.h"
+#endif
+#if PG_VERSION_NUM >= 130000
+#include "common/hashfn.h"
+#elif PG_VERSION_NUM >= 120000
+#include "utils/hashutils.h"
+#endif
+#if PG_VERSION_NUM >= 120000
+#include "access/table.h"
+#include "catalog/pg_operator.h"
+#include "nodes/makefuncs.h"
+#include "nodes/pathnodes.h"
+#include "nodes/supportnodes.h"
+#include "parser/parse_func.h"
+#include "parser/parsetree.h"
+#include "utils/partcache.h"
+#include "utils/rel.h"
+#endif
+#include "mb/pg_wchar.h"
+#include "utils/numeric.h"
+#if PG_VERSION_NUM >= 90400
+#include "utils/jsonb.h"
+#endif
+#if PG_VERSION_NUM >= 130000
+#include "access/detoast.h"
+#else
+#include "access/tuptoaster.h"
+#endif
 #include "port.h"
+#if PG_VERSION_NUM >= 160000
+#include "nodes/miscnodes.h"
+#include "port/simd.h"
+#endif
 
 /* fn_extra cache entry */
 typedef struct VariantCache
@@ -41,21 +97,332 @@ typedef struct VariantCache
 	char						typalign;
 	IOFuncSelector	IOfunc; /* We should always either be in or out; make sure we're not mixing. */
 	char						*formatted_name;	/* Formatted type string. Only set when IOfunc is output/send */
+	char						*out_prefix;	/* "(" + quoted formatted_name + ",". Only set when IOfunc is output/send */
+	int							out_prefix_len;
+	MemoryContext		scratch;		/* Per-call garbage; see get_scratch() */
 } VariantCache;
 
 #define GetCache(fcinfo) ((VariantCache *) fcinfo->flinfo->fn_extra)
 
+#if PG_VERSION_NUM >= 90500
+/*
+ * Expanded variant
+ *
+ * Keeps the decoded VariantInt next to the flat value, so repeated operations
+ * on a variant in a PL/pgSQL variable don't have to detoast and decode it
+ * every time. See variant_expand().
+ */
+#define EXPANDED_VARIANT_MAGIC	0x76617269	/* "vari" */
+typedef struct ExpandedVariant
+{
+	ExpandedObjectHeader	hdr;
+	int										magic;
+	Variant								flat;			/* Detoasted copy of the flat value */
+	VariantDataInt				vi;				/* Decoded flat; data lives in hdr.eoh_context */
+} ExpandedVariant;
+
+static Size variant_expanded_get_flat_size(ExpandedObjectHeader *eohptr);
+static void variant_expanded_flatten_into(ExpandedObjectHeader *eohptr,
+							  void *result, Size allocated_size);
+
+static const ExpandedObjectMethods variant_expanded_methods =
+{
+	variant_expanded_get_flat_size,
+	variant_expanded_flatten_into
+};
+#endif
+
+/*
+ * Runtime statistics
+ *
+ * Every backend keeps its own counters. If we're in shared_preload_libraries
+ * we also keep a cluster-wide aggregate in shared memory; each backend adds
+ * whatever has changed since it last did so at the end of every transaction.
+ *
+ * If you add a counter make sure to update stat_names.
+ */
+typedef enum
+{
+	STAT_CACHE_HIT,
+	STAT_CACHE_MISS,
+	STAT_CACHE_EVICTION,
+	STAT_SPI_CMP,
+	STAT_SPI_CAST_OUT,
+	STAT_SPI_TYPMOD_IN,
+	STAT_SPI_GET_VARIANT_NAME,
+	STAT_SPI_GET_INT_OID,
+	STAT_BYTES_DETOASTED,
+	STAT_BYTES_COPIED,
+	STAT_EXPANDED_HIT,
+	STAT_REGISTRY_HIT,
+	NUM_STATS
+} VariantStat;
+
+static const char *stat_names[NUM_STATS] = {
+	"cache_hits",
+	"cache_misses",
+	"cache_evictions",
+	"spi_cmp",
+	"spi_cast_out",
+	"spi_typmod_in",
+	"spi_get_variant_name",
+	"spi_get_int_oid",
+	"bytes_detoasted",
+	"bytes_copied",
+	"expanded_hits",
+	"registry_hits"
+};
+
+typedef struct VariantSharedStats
+{
+	slock_t					mutex;
+	int64						stats[NUM_STATS];
+} VariantSharedStats;
+
+static int64 local_stats[NUM_STATS];
+static int64 local_stats_flushed[NUM_STATS]; /* What we've added to shared_stats */
+static VariantSharedStats *shared_stats = NULL;
+
+#define STAT_INCR(stat)				(local_stats[stat]++)
+#define STAT_ADD(stat, n)			(local_stats[stat] += (n))
+
+/*
+ * Slow path tracing
+ *
+ * If variant.log_slow_paths is on then we time every slow path event (SPI
+ * calls and cache evictions) and remember the total for each distinct call
+ * site and pair of types. At the end of each top level query (or transaction,
+ * if we never see the end of the query) we report one message per distinct
+ * event at variant.log_slow_paths_level.
+ *
+ * Call sites are identified by their VariantStat.
+ */
+typedef struct SlowPathKey
+{
+	VariantStat			site;
+	Oid							type1;
+	Oid							type2;
+} SlowPathKey;
+
+typedef struct SlowPathEntry
+{
+	SlowPathKey			key;
+	int64						calls;
+	instr_time			total;
+} SlowPathEntry;
+
+static bool log_slow_paths = false;
+static int log_slow_paths_level = LOG;
+static HTAB *slow_paths = NULL;
+static int executor_depth = 0;
+static int spi_depth = 0;
+
+/*
+ * An error skips ExecutorEnd() and _SPI_disc(), so we remember the depths at
+ * the start of each subtransaction and put them back if it aborts.
+ */
+typedef struct DepthSave
+{
+	SubTransactionId	subid;
+	int								executor_depth;
+	int								spi_depth;
+	struct DepthSave	*next;
+} DepthSave;
+
+static DepthSave *depth_saves = NULL;
+
+static const struct config_enum_entry log_slow_paths_level_options[] = {
+	{"debug5", DEBUG5, false},
+	{"debug4", DEBUG4, false},
+	{"debug3", DEBUG3, false},
+	{"debug2", DEBUG2, false},
+	{"debug1", DEBUG1, false},
+	{"debug", DEBUG2, true},
+	{"info", INFO, false},
+	{"notice", NOTICE, false},
+	{"warning", WARNING, false},
+	{"log", LOG, false},
+	{NULL, 0, false}
+};
+
+#define SLOW_PATH_START(start) \
+	do { if (log_slow_paths) INSTR_TIME_SET_CURRENT(start); } while (0)
+#define SLOW_PATH_END(site, type1, type2, start) \
+	do { if (log_slow_paths) slow_path_record(site, type1, type2, &(start)); } while (0)
+
+/*
+ * Registered variant cache
+ *
+ * We need the registration record for every variant we create, so each
+ * backend keeps the _variant._registered rows it has looked at. The whole
+ * cache is thrown away when we get a relcache invalidation for
+ * _variant._registered; _variant._tg_registered_inval() sends one whenever
+ * the table is modified.
+ */
+typedef struct RegisteredVariant
+{
+	int							typmod;			/* hash key */
+	char						*variant_name;
+	bool						enabled;
+	bool						storage_allowed;
+	bool						dynamic;
+	int							intern_threshold;	/* 0 if not interning */
+	Oid							fixed_type;			/* InvalidOid if not a fixed type variant */
+	int16						fixed_typlen;
+	bool						fixed_typbyval;
+	char						fixed_typalign;
+	int							nallowed;
+	Oid							*allowed_types;
+} RegisteredVariant;
+
+static HTAB *registry_cache = NULL;
+static MemoryContext registry_cxt = NULL;
+static bool registry_valid = false;
+static Oid registry_relid = InvalidOid;
+static Oid int_type_oid = InvalidOid;	/* variant._variant; see getIntOid() */
+
+/* Hash key for things we track per (registered variant, original type) */
+typedef struct VariantTypeKey
+{
+	int							typmod;
+	Oid							typid;
+} VariantTypeKey;
+
+/*
+ * Bulk load mode
+ *
+ * With variant.bulk_load on, variant_check_type() only checks each (typmod,
+ * type) pair the first time it sees it in a statement, and counts how many
+ * variants of each pair were created. The counts are reported at the end of
+ * each top level query, or at commit for things that don't go through the
+ * executor (ie: COPY).
+ */
+typedef struct BulkLoadEntry
+{
+	VariantTypeKey	key;
+	char						*variant_name;
+	int64						rows;
+} BulkLoadEntry;
+
+static bool bulk_load = false;
+static HTAB *bulk_pairs = NULL;
+static MemoryContext bulk_cxt = NULL;
+
+/*
+ * Types approved by dynamic variants in this transaction; see
+ * approval_record(). Entries are just a VariantTypeKey.
+ */
+static HTAB *approvals = NULL;
+static MemoryContext approval_cxt = NULL;
+
+/*
+ * Interned payloads we've seen, by digest; see variant_intern(). Payloads
+ * never change, so entries only go away when the cache gets too big.
+ */
+typedef struct InternEntry
+{
+	uint8						digest[VAR_INTERNED_LEN];	/* hash key */
+	bytea						*payload;
+	bool						stored;			/* known to be in _variant._interned */
+} InternEntry;
+
+static HTAB *intern_cache = NULL;
+static MemoryContext intern_cxt = NULL;
+static Size intern_cache_bytes = 0;
+static int intern_cache_size = 16384;	/* kB */
+
+/* Cache warming; see variant_warm_caches() */
+static char *preload_types = NULL;
+static bool warm_pending = false;
+
+/* CBOR major types and simple values we use */
+#define CBOR_UINT				0
+#define CBOR_NEGINT			1
+#define CBOR_BYTES			2
+#define CBOR_TEXT				3
+#define CBOR_ARRAY			4
+#define CBOR_SIMPLE			7
+#define CBOR_INDEFINITE	31
+#define CBOR_FALSE			0xf4
+#define CBOR_TRUE				0xf5
+#define CBOR_NULL				0xf6
+#define CBOR_FLOAT4			0xfa
+#define CBOR_FLOAT8			0xfb
+#define CBOR_BREAK			0xff
+
+typedef struct CborReader
+{
+	const uint8			*p;
+	const uint8			*end;
+} CborReader;
+
 static Variant variant_in_int(FunctionCallInfo fcinfo, char *input, int variant_typmod);
-static char * variant_out_int(FunctionCallInfo fcinfo, Variant input);
+static char * variant_out_int(FunctionCallInfo fcinfo, VariantInt vi);
+static size_t variant_quote_scan(const char *str, size_t len);
 static int variant_cmp_int(FunctionCallInfo fcinfo);
+static int variant_image_cmp_int(FunctionCallInfo fcinfo);
+static int variant_type_cmp_int(FunctionCallInfo fcinfo);
+#if PG_VERSION_NUM >= 120000
+static Oid partitioned_by_type(PlannerInfo *root, Var *var);
+#endif
 static char * variant_get_variant_name(int typmod, Oid org_typid, bool ignore_storage);
+static void variant_check_type(int typmod, Oid typid);
+static void bulk_load_report(void);
+static void bulk_load_reset(void);
+static bool approval_record(int typmod, Oid typid);
+static void approval_flush(void);
+static void approval_reset(void);
+static Variant variant_pack(Variant v, int variant_typmod);
+static Variant variant_compact(Variant v, int variant_typmod, RegisteredVariant *rv);
+static void compact_decode(struct varlena *v, VariantInt vi, int16 *typlen, bool *typbyval, char *typalign);
+static Variant compact_expand(struct varlena *v);
+static struct varlena *variant_detoast_stored(Datum d);
+static Variant variant_intern(Variant v, int variant_typmod);
+static bool variant_is_interned(struct varlena *v);
+static bool variant_is_compact(struct varlena *v);
+static Variant intern_resolve(struct varlena *v);
+static InternEntry *intern_cache_entry(const uint8 *digest, bytea *payload, bool create);
+static void intern_store(bytea *payload);
+static void intern_ensure_stored(struct varlena *v);
+static void intern_forget_stored(void);
+static Variant variant_detoast_packed(Datum d);
 static VariantInt make_variant_int(Variant v, FunctionCallInfo fcinfo, IOFuncSelector func);
+static VariantInt variant_get_int(FunctionCallInfo fcinfo, int argno, IOFuncSelector func, bool *shared);
 static Variant make_variant(VariantInt vi, FunctionCallInfo fcinfo, IOFuncSelector func);
+static Variant make_variant_typ(VariantInt vi, int16 typlen, bool typbyval, char typalign);
 static VariantCache * get_cache(FunctionCallInfo fcinfo, VariantInt vi, IOFuncSelector func);
+static MemoryContext get_scratch(FunctionCallInfo fcinfo);
+static char * variant_out_arg(FunctionCallInfo fcinfo, int argno);
 static Oid getIntOid();
+static Oid registry_relid_get(void);
+static void registry_inval_callback(Datum arg, Oid relid);
+static void registry_load(int typmod, bool all);
+static void registry_reset(void);
+static RegisteredVariant *registry_lookup(int typmod);
+static void variant_warm_caches(void);
+static void warm_caches_load(void);
+static void cbor_put_head(StringInfo buf, int major, uint64 val);
+static void cbor_put_type(StringInfo buf, Oid typid, int typmod, const char *name);
+static void cbor_put_variant(FunctionCallInfo fcinfo, StringInfo buf, Variant v);
+static bytea *cbor_to_bytea(StringInfo buf);
+static void sort_key_put_variant(StringInfo buf, VariantInt vi);
+static int cbor_get_head(CborReader *r, uint64 *val, bool *indefinite);
+static bool cbor_at_break(CborReader *r);
+static Datum cbor_get_variant(FunctionCallInfo fcinfo, CborReader *r, int variant_typmod, bool *isnull);
 static Oid get_oid(Variant v, uint *flags);
+static Oid get_oid_datum(Datum d, uint *flags);
 static bool _SPI_conn();
 static void _SPI_disc(bool pop);
+static Oid variant_owner(void);
+static void stats_flush(void);
+static void stats_shmem_startup(void);
+static void slow_path_record(VariantStat site, Oid type1, Oid type2, instr_time *start);
+static void slow_path_report(void);
+static void variant_xact_callback(XactEvent event, void *arg);
+static void variant_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
+									 SubTransactionId parentSubid, void *arg);
+static void variant_ExecutorStart(QueryDesc *queryDesc, int eflags);
+static void variant_ExecutorEnd(QueryDesc *queryDesc);
 
 static int32 get_fn_expr_argtypmod(FmgrInfo *flinfo, int argnum);
 static int32 get_call_expr_argtypmod(Node *expr, int argnum);
@@ -70,6 +437,102 @@ static StringInfo quote_variant_name_cstring(const char *variant_name);
 
 PG_MODULE_MAGIC;
 
+void _PG_init(void);
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static void stats_shmem_request(void);
+#endif
+static ExecutorStart_hook_type prev_ExecutorStart = NULL;
+static ExecutorEnd_hook_type prev_ExecutorEnd = NULL;
+
+/*
+ * _PG_init: Module load callback
+ *
+ * Shared memory for cluster-wide statistics can only be set up if we're in
+ * shared_preload_libraries. Without it we still keep per-backend statistics.
+ */
+void
+_PG_init(void)
+{
+	DefineCustomBoolVariable("variant.log_slow_paths",
+							 "Report slow path events (SPI calls and cache evictions) at the end of each query.",
+							 NULL,
+							 &log_slow_paths,
+							 false,
+							 PGC_SUSET,
+							 0,
+							 NULL, NULL, NULL);
+	DefineCustomEnumVariable("variant.log_slow_paths_level",
+							 "Message level used by variant.log_slow_paths.",
+							 NULL,
+							 &log_slow_paths_level,
+							 LOG,
+							 log_slow_paths_level_options,
+							 PGC_SUSET,
+							 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomBoolVariable("variant.bulk_load",
+							 "Check each registered variant and type combination once per statement, and report how many of each were created.",
+							 NULL,
+							 &bulk_load,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL, NULL, NULL);
+	DefineCustomIntVariable("variant.intern_cache_size",
+							"Maximum memory used to cache interned variant payloads.",
+							NULL,
+							&intern_cache_size,
+							16384,
+							0,
+							MAX_KILOBYTES,
+							PGC_USERSET,
+							GUC_UNIT_KB,
+							NULL, NULL, NULL);
+	DefineCustomStringVariable("variant.preload_types",
+							   "Comma separated list of types whose catalog information is loaded when a preloaded variant library starts a backend.",
+							   NULL,
+							   &preload_types,
+							   "",
+							   PGC_SUSET,
+							   0,
+							   NULL, NULL, NULL);
+
+	CacheRegisterRelcacheCallback(registry_inval_callback, (Datum) 0);
+
+	/*
+	 * If we're in shared_preload_libraries or session_preload_libraries warm
+	 * our caches before the first query runs. Either way there's no
+	 * transaction yet, and the catalogs can't be read until there is, so
+	 * variant_ExecutorStart does the actual work. If we're loaded by a
+	 * variant function call our caches are about to be filled anyway.
+	 */
+	warm_pending = process_shared_preload_libraries_in_progress || !IsTransactionState();
+
+	prev_ExecutorStart = ExecutorStart_hook;
+	ExecutorStart_hook = variant_ExecutorStart;
+	prev_ExecutorEnd = ExecutorEnd_hook;
+	ExecutorEnd_hook = variant_ExecutorEnd;
+
+	RegisterXactCallback(variant_xact_callback, NULL);
+	RegisterSubXactCallback(variant_subxact_callback, NULL);
+
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+#if PG_VERSION_NUM >= 150000
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = stats_shmem_request;
+#else
+	RequestAddinShmemSpace(MAXALIGN(sizeof(VariantSharedStats)));
+#endif
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = stats_shmem_startup;
+}
+
 /*
  * variant_in: Parse text representation of a variant
  *
@@ -102,7 +565,10 @@ PG_FUNCTION_INFO_V1(variant_cast_in);
 Datum
 variant_cast_in(PG_FUNCTION_ARGS)
 {
-	VariantInt			vi = palloc0(sizeof(*vi));
+	VariantDataInt	vid;
+	VariantInt			vi = &vid;
+
+	MemSet(vi, 0, sizeof(*vi));
 
 	vi->isnull = PG_ARGISNULL(0);
 	vi->typid = get_fn_expr_argtype(fcinfo->flinfo, 0);
@@ -116,20 +582,20 @@ variant_cast_in(PG_FUNCTION_ARGS)
 	/* Validate that we're casting to a registered variant */
 	if( PG_ARGISNULL(1) )
 		elog( ERROR, "Target typemod must not be NULL" );
-	variant_get_variant_name(PG_GETARG_INT32(1), vi->typid, false);
+	variant_check_type(PG_GETARG_INT32(1), vi->typid);
 
 	if( !vi->isnull )
 		vi->data = PG_GETARG_DATUM(0);
 
 	/* Since we're casting in, we'll call for INFunc_input, even though we don't need it */
-	PG_RETURN_VARIANT( make_variant(vi, fcinfo, IOFunc_input) );
+	PG_RETURN_VARIANT( variant_pack(make_variant(vi, fcinfo, IOFunc_input), PG_GETARG_INT32(1)) );
 }
 
 PG_FUNCTION_INFO_V1(variant_out);
 Datum
 variant_out(PG_FUNCTION_ARGS)
 {
-	PG_RETURN_CSTRING( variant_out_int(fcinfo, PG_GETARG_VARIANT(0)) );
+	PG_RETURN_CSTRING( variant_out_arg(fcinfo, 0) );
 }
 
 /*
@@ -146,12 +612,13 @@ variant_cast_out(PG_FUNCTION_ARGS)
 	Oid							targettypid = get_fn_expr_rettype(fcinfo->flinfo);
 	VariantInt			vi;
 	Datum						out;
+	bool						shared;
 
 	if( PG_ARGISNULL(0) )
 		PG_RETURN_NULL();
 
 	/* No reason to format type name, so use IOFunc_input instead of IOFunc_output */
-	vi = make_variant_int(PG_GETARG_VARIANT(0), fcinfo, IOFunc_input);
+	vi = variant_get_int(fcinfo, 0, IOFunc_input, &shared);
 
 	/* If original was NULL then we MUST return NULL */
 	if( vi->isnull )
@@ -159,7 +626,12 @@ variant_cast_out(PG_FUNCTION_ARGS)
 
 	/* If our types match exactly we don't need to cast */
 	if( vi->typid == targettypid )
+	{
+		/* Data belonging to an expanded variant must not escape */
+		if (shared)
+			PG_RETURN_DATUM(datumCopy(vi->data, GetCache(fcinfo)->typbyval, GetCache(fcinfo)->typlen));
 		PG_RETURN_DATUM(vi->data);
+	}
 
 	/* Keep cruft localized to just here */
 	{
@@ -171,7 +643,10 @@ variant_cast_out(PG_FUNCTION_ARGS)
 		StringInfoData	cmdd;
 		StringInfo			cmd = &cmdd;
 		char						*nulls = " ";
+		instr_time			start;
 
+		STAT_INCR(STAT_SPI_CAST_OUT);
+		SLOW_PATH_START(start);
 		do_pop = _SPI_conn();
 
 		initStringInfo(cmd);
@@ -193,6 +668,7 @@ variant_cast_out(PG_FUNCTION_ARGS)
 
 		/* Remember this frees everything palloc'd since our connect/push call */
 		_SPI_disc(do_pop);
+		SLOW_PATH_END(STAT_SPI_CAST_OUT, vi->typid, targettypid, start);
 	}
 	/* End cruft */
 
@@ -227,9 +703,14 @@ variant_typmod_in(PG_FUNCTION_ARGS)
 		bool						isnull;
 		int							ret;
 		Oid							type = TEXTOID;
+		instr_time			start;
+
 		/* This should arguably be FOR KEY SHARE. See comment in variant_get_variant_name() */
 		char						*cmd = "SELECT variant_typmod, variant_enabled FROM variant._registered WHERE lower(variant_name) = lower($1)";
 
+		STAT_INCR(STAT_SPI_TYPMOD_IN);
+		SLOW_PATH_START(start);
+
 		/* command, nargs, Oid *argument_types, *values, *nulls, read_only, count */
 		if( (ret = SPI_execute_with_args( cmd, 1, &type, &inputDatum, " ", true, 0 )) != SPI_OK_SELECT )
 			elog( ERROR, "SPI_execute_with_args(%s) returned %s", cmd, SPI_result_code_string(ret));
@@ -267,6 +748,7 @@ variant_typmod_in(PG_FUNCTION_ARGS)
 			);
 
 		_SPI_disc(do_pop);
+		SLOW_PATH_END(STAT_SPI_TYPMOD_IN, InvalidOid, InvalidOid, start);
 	}
 
 	PG_RETURN_INT32(out);
@@ -329,19 +811,70 @@ PG_FUNCTION_INFO_V1(variant_text_out);
 Datum
 variant_text_out(PG_FUNCTION_ARGS)
 {
-	PG_RETURN_DATUM( CStringGetTextDatum( variant_out_int(fcinfo, PG_GETARG_VARIANT(0)) ) );
+	PG_RETURN_DATUM( CStringGetTextDatum( variant_out_arg(fcinfo, 0) ) );
+}
+
+/*
+ * variant_expand: Return a variant as a read/write expanded object
+ *
+ * PL/pgSQL keeps read/write expanded objects that are assigned to a variable
+ * as they are, and passes them to functions as read-only pointers.
+ * variant_get_int() can then use the decoded form directly. Anything that
+ * stores the variant gets the flat form.
+ *
+ * Before 9.5 there are no expanded objects, so this just returns its input.
+ */
+PG_FUNCTION_INFO_V1(variant_expand);
+Datum
+variant_expand(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM >= 90500
+	Variant					v = PG_GETARG_VARIANT(0);
+	MemoryContext		objcxt;
+	MemoryContext		oldcxt;
+	ExpandedVariant	*ev;
+	VariantInt			vi;
+
+	Assert(fcinfo->flinfo->fn_strict); /* Must be strict */
+
+	objcxt = AllocSetContextCreate(CurrentMemoryContext, "expanded variant",
+			ALLOCSET_SMALL_MINSIZE, ALLOCSET_SMALL_INITSIZE, ALLOCSET_SMALL_MAXSIZE);
+	ev = MemoryContextAlloc(objcxt, sizeof(ExpandedVariant));
+	EOH_init_header(&ev->hdr, &variant_expanded_methods, objcxt);
+	ev->magic = EXPANDED_VARIANT_MAGIC;
+
+	oldcxt = MemoryContextSwitchTo(objcxt);
+	ev->flat = palloc(VARSIZE(v));
+	memcpy(ev->flat, v, VARSIZE(v));
+
+	/* Any IO function will do; we only need the storage info */
+	vi = make_variant_int(ev->flat, fcinfo, IOFunc_input);
+	ev->vi = *vi;
+	pfree(vi);
+	MemoryContextSwitchTo(oldcxt);
+
+	PG_RETURN_DATUM(EOHPGetRWDatum(&ev->hdr));
+#else
+	PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+#endif
 }
 
+/*
+ * variant_type_out: Return original type of a variant
+ *
+ * Only the variant header is needed, so use get_oid_datum() instead of
+ * detoasting the whole thing. This is what makes variant.type_census() cheap
+ * on TOASTed values.
+ */
 PG_FUNCTION_INFO_V1(variant_type_out);
 Datum
 variant_type_out(PG_FUNCTION_ARGS)
 {
-	VariantInt		vi;
+	uint					flags;
 
 	Assert(fcinfo->flinfo->fn_strict); /* Must not be callable on NULL input */
-	vi = make_variant_int(PG_GETARG_VARIANT(0), fcinfo, IOFunc_output);
 
-	PG_RETURN_OID(vi->typid);
+	PG_RETURN_OID(get_oid_datum(PG_GETARG_DATUM(0), &flags));
 }
 
 /*
@@ -433,24 +966,25 @@ PG_FUNCTION_INFO_V1(variant_image_eq);
 Datum
 variant_image_eq(PG_FUNCTION_ARGS)
 {
-	Variant	l = (Variant) PG_GETARG_DATUM(0);
-	Variant	r = (Variant) PG_GETARG_DATUM(1);
+	Variant	l;
+	Variant	r;
 	int			cmp;
 
 	/*
-	 * To avoid detoasting we use _ANY variations on VAR*, but that means we must
-	 * make sure to use VARSIZE_ANY_EXHDR, *not* VARSIZE_ANY!
+	 * We have to detoast before comparing sizes; a compressed or interned
+	 * value is a different size than the value itself. We could theoretically
+	 * leave data compressed, but since there's no direct support for that we
+	 * don't bother.
+	 *
+	 * To avoid copying short values we use _ANY variations on VAR*, but that
+	 * means we must make sure to use VARSIZE_ANY_EXHDR, *not* VARSIZE_ANY!
 	 */
+	l = variant_detoast_packed(PG_GETARG_DATUM(0));
+	r = variant_detoast_packed(PG_GETARG_DATUM(1));
 	if(VARSIZE_ANY_EXHDR(l) != VARSIZE_ANY_EXHDR(r))
-		PG_RETURN_BOOL(false);
-	
-	/*
-	 * At this point we need to detoast. We could theoretically leave data
-	 * compressed, but since there's no direct support for that we don't bother.
-	 */
-	l = (Variant) PG_DETOAST_DATUM_PACKED(l);
-	r = (Variant) PG_DETOAST_DATUM_PACKED(r);
-	cmp = memcmp(VARDATA_ANY(l), VARDATA_ANY(r), VARSIZE_ANY_EXHDR(l));
+		cmp = 1;
+	else
+		cmp = memcmp(VARDATA_ANY(l), VARDATA_ANY(r), VARSIZE_ANY_EXHDR(l));
 
 	PG_FREE_IF_COPY(l, 0);
 	PG_FREE_IF_COPY(r, 1);
@@ -462,7 +996,7 @@ PG_FUNCTION_INFO_V1(variant_hash);
 Datum
 variant_hash(PG_FUNCTION_ARGS)
 {
-	Variant	v = (Variant) PG_DETOAST_DATUM_PACKED(PG_GETARG_DATUM(0));
+	Variant	v = variant_detoast_packed(PG_GETARG_DATUM(0));
 	char	   *data;
 	int			len;
 	Datum		result;
@@ -481,711 +1015,4490 @@ variant_hash(PG_FUNCTION_ARGS)
 }
 
 /*
- ********************
- * SUPPORT FUNCTIONS
- ********************
+ * variant_hash_extended: 64 bit seeded version of variant_hash
+ *
+ * Needed for hash partitioning. With a seed of 0 the low 32 bits match
+ * variant_hash().
  */
-
-static Variant
-variant_in_int(FunctionCallInfo fcinfo, char *input, int variant_typmod)
+#if PG_VERSION_NUM >= 110000
+PG_FUNCTION_INFO_V1(variant_hash_extended);
+Datum
+variant_hash_extended(PG_FUNCTION_ARGS)
 {
-	VariantCache	*cache;
-	bool					isnull;
-	Oid						intTypeOid = InvalidOid;
-	int32					typmod = 0;
-	text					*orgType;
-	text					*orgData;
-	VariantInt		vi = palloc0(sizeof(*vi));
-
-	/* Eventually getting rid of this crap, so segregate it */
-		intTypeOid = getIntOid();
+	Variant	v = variant_detoast_packed(PG_GETARG_DATUM(0));
+	Datum		result;
 
-		FmgrInfo	 		proc;
-		Datum						composite;
-		HeapTupleHeader	composite_tuple;
-		Oid							typioparam;
-		Oid							typIoFunc;
+	Assert(fcinfo->flinfo->fn_strict); /* Must be strict */
 
-		/* Cast input data to our internal composite type */
-		getTypeInputInfo(intTypeOid, &typIoFunc, &typioparam);
-		fmgr_info_cxt(typIoFunc, &proc, fcinfo->flinfo->fn_mcxt);
-		composite=InputFunctionCall(&proc, input, typioparam, typmod);
+	result = hash_any_extended((unsigned char *) VARDATA_ANY(v), VARSIZE_ANY_EXHDR(v),
+							   PG_GETARG_INT64(1));
 
-		/* Extract data from internal composite type */
-		composite_tuple=DatumGetHeapTupleHeader(composite);
-		orgType = (text *) GetAttributeByNum( composite_tuple, 1, &isnull );
-		if (isnull)
-			elog(ERROR, "original_type of variant must not be NULL");
-		orgData = (text *) GetAttributeByNum( composite_tuple, 2, &vi->isnull );
-	/* End crap */
+	/* Avoid leaking memory for toasted inputs */
+	PG_FREE_IF_COPY(v, 0);
 
-#ifdef LONG_PARSETYPE
-	parseTypeString(text_to_cstring(orgType), &vi->typid, &vi->typmod, false);
-#else
-	parseTypeString(text_to_cstring(orgType), &vi->typid, &vi->typmod);
+	return result;
+}
 #endif
 
-	/*
-	 * Verify we've been handed a valid typmod
-	 */
-	variant_get_variant_name(variant_typmod, vi->typid, false);
+/*
+ * IMAGE ORDERING
+ *
+ * This is *not* a meaningful ordering of values. Variants are ordered by
+ * original type first, then original typmod, then by the raw bytes that we
+ * store. That's enough to make btree happy, and it means that all variants of
+ * a given type sort together, which is what allows an index to answer "is of
+ * type" tests (see variant_type_cmp()).
+ *
+ * This ordering is consistent with variant_image_eq().
+ */
+PG_FUNCTION_INFO_V1(variant_image_cmp);
+Datum
+variant_image_cmp(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_INT32(variant_image_cmp_int(fcinfo));
+}
 
-	cache = get_cache(fcinfo, vi, IOFunc_input);
+PG_FUNCTION_INFO_V1(variant_image_lt);
+Datum
+variant_image_lt(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(variant_image_cmp_int(fcinfo) < 0);
+}
+PG_FUNCTION_INFO_V1(variant_image_le);
+Datum
+variant_image_le(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(variant_image_cmp_int(fcinfo) <= 0);
+}
+PG_FUNCTION_INFO_V1(variant_image_ge);
+Datum
+variant_image_ge(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(variant_image_cmp_int(fcinfo) >= 0);
+}
+PG_FUNCTION_INFO_V1(variant_image_gt);
+Datum
+variant_image_gt(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(variant_image_cmp_int(fcinfo) > 0);
+}
 
-	if (!vi->isnull)
-		/* Actually need to be using stringTypeDatum(Type tp, char *string, int32 atttypmod) */
-		vi->data = InputFunctionCall(&cache->proc, text_to_cstring(orgData), cache->typioparam, vi->typmod);
+/*
+ * TYPE TEST FUNCTIONS
+ *
+ * Compare the original type of a variant to a regtype. These are cross-type
+ * members of the image ordering btree family, so an index using
+ * btree__variant_type_ops can answer them by descending on the type Oid
+ * prefix of the key. Only the variant header is looked at.
+ */
+PG_FUNCTION_INFO_V1(variant_type_cmp);
+Datum
+variant_type_cmp(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_INT32(variant_type_cmp_int(fcinfo));
+}
+
+PG_FUNCTION_INFO_V1(variant_type_lt);
+Datum
+variant_type_lt(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(variant_type_cmp_int(fcinfo) < 0);
+}
+PG_FUNCTION_INFO_V1(variant_type_le);
+Datum
+variant_type_le(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(variant_type_cmp_int(fcinfo) <= 0);
+}
+PG_FUNCTION_INFO_V1(variant_type_eq);
+Datum
+variant_type_eq(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(variant_type_cmp_int(fcinfo) == 0);
+}
+PG_FUNCTION_INFO_V1(variant_type_ne);
+Datum
+variant_type_ne(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(variant_type_cmp_int(fcinfo) != 0);
+}
+PG_FUNCTION_INFO_V1(variant_type_ge);
+Datum
+variant_type_ge(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(variant_type_cmp_int(fcinfo) >= 0);
+}
+PG_FUNCTION_INFO_V1(variant_type_gt);
+Datum
+variant_type_gt(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(variant_type_cmp_int(fcinfo) > 0);
+}
 
-	return make_variant(vi, fcinfo, IOFunc_input);
+/*
+ * variant_type_eq_support: Planner support function for variant_type_eq
+ *
+ * A table can be list partitioned by type with
+ * PARTITION BY LIST (variant.original_type(v)), but partition pruning only
+ * understands clauses that use the partition key expression itself, so
+ * v @= 'int4' wouldn't prune anything. If v belongs to a table that is
+ * partitioned on variant.original_type(v) we turn the test into
+ * variant.original_type(v) = 'int4'::regtype, which does prune.
+ *
+ * Anywhere else the test is left alone, so it can still use an index built
+ * with btree__variant_type_ops.
+ */
+#if PG_VERSION_NUM >= 120000
+PG_FUNCTION_INFO_V1(variant_type_eq_support);
+Datum
+variant_type_eq_support(PG_FUNCTION_ARGS)
+{
+	Node							*rawreq = (Node *) PG_GETARG_POINTER(0);
+	SupportRequestSimplify	*req;
+	Var								*var;
+	Node							*type;
+	Oid								original_type;
+	Expr							*key;
+	OpExpr						*result;
+
+	if (!IsA(rawreq, SupportRequestSimplify))
+		PG_RETURN_POINTER(NULL);
+
+	req = (SupportRequestSimplify *) rawreq;
+	if (req->root == NULL || list_length(req->fcall->args) != 2)
+		PG_RETURN_POINTER(NULL);
+
+	type = lsecond(req->fcall->args);
+	if (!IsA(linitial(req->fcall->args), Var) || !IsA(type, Const))
+		PG_RETURN_POINTER(NULL);
+	var = (Var *) linitial(req->fcall->args);
+
+	original_type = partitioned_by_type(req->root, var);
+	if (!OidIsValid(original_type))
+		PG_RETURN_POINTER(NULL);
+
+	key = (Expr *) makeFuncExpr(original_type, REGTYPEOID, list_make1(copyObject(var)),
+								InvalidOid, InvalidOid, COERCE_EXPLICIT_CALL);
+	result = (OpExpr *) make_opclause(OIDEqualOperator, BOOLOID, false,
+									  key, (Expr *) copyObject(type),
+									  InvalidOid, InvalidOid);
+	set_opfuncid(result);
+
+	PG_RETURN_POINTER(result);
 }
+#endif
 
-static char *
-variant_out_int(FunctionCallInfo fcinfo, Variant input)
+/*
+ * JSONB CONVERSION
+ *
+ * Numeric, boolean and string payloads become jsonb scalars and a NULL
+ * payload becomes a json null. Those are read straight out of the variant
+ * instead of going through the type's output function (except floats; see
+ * below). A jsonb payload is returned as is. Anything else becomes a tagged
+ * object, {"type": "box", "value": "(1,1),(0,0)"}.
+ *
+ * Going the other way, json strings, numbers and booleans become text,
+ * numeric and boolean, a tagged object becomes the type it names, json null
+ * becomes NULL and any other document is stored as jsonb.
+ */
+#if PG_VERSION_NUM >= 90400
+PG_FUNCTION_INFO_V1(variant_to_jsonb);
+Datum
+variant_to_jsonb(PG_FUNCTION_ARGS)
 {
+	Variant				v = PG_GETARG_VARIANT(0);
 	VariantCache	*cache;
-	bool					need_quote;
-	char					*tmp;
-	char					*org_cstring;
-	StringInfoData	outd;
-	StringInfo		out = &outd;
 	VariantInt		vi;
+	JsonbValue		jbv;
+	uint					flags;
+	Oid						typid;
 
 	Assert(fcinfo->flinfo->fn_strict); /* Must be strict */
 
-	vi = make_variant_int(input, fcinfo, IOFunc_output);
+	typid = get_oid(v, &flags);
+#ifdef VARIANT_TEST_OID
+	typid -= OID_MASK;
+#endif
+
+	/* Strings don't need to be copied at all; point at our payload */
+	if (!(flags & VAR_ISNULL) &&
+			(typid == TEXTOID || typid == VARCHAROID || typid == BPCHAROID))
+	{
+		jbv.type = jbvString;
+		jbv.val.string.val = VDATAPTR(v);
+		jbv.val.string.len = VARSIZE(v) - VHDRSZ - (flags & VAR_OVERFLOW ? 1 : 0);
+		PG_RETURN_POINTER(JsonbValueToJsonb(&jbv));
+	}
+
+	vi = make_variant_int(v, fcinfo, IOFunc_output);
 	cache = GetCache(fcinfo);
-	Assert(cache->formatted_name);
 
-	/* Start building string */
-	initStringInfo(out);
-	appendStringInfoChar(out, '(');
+	if (vi->isnull)
+	{
+		jbv.type = jbvNull;
+		PG_RETURN_POINTER(JsonbValueToJsonb(&jbv));
+	}
 
-	need_quote = false;
-	for (tmp = cache->formatted_name; *tmp; tmp++)
+	switch (vi->typid)
 	{
-		char		ch = *tmp;
+		case JSONBOID:
+			PG_RETURN_DATUM(vi->data);
+		case BOOLOID:
+			jbv.type = jbvBool;
+			jbv.val.boolean = DatumGetBool(vi->data);
+			PG_RETURN_POINTER(JsonbValueToJsonb(&jbv));
+		case INT2OID:
+			jbv.type = jbvNumeric;
+			jbv.val.numeric = DatumGetNumeric(DirectFunctionCall1(int2_numeric, vi->data));
+			PG_RETURN_POINTER(JsonbValueToJsonb(&jbv));
+		case INT4OID:
+			jbv.type = jbvNumeric;
+			jbv.val.numeric = DatumGetNumeric(DirectFunctionCall1(int4_numeric, vi->data));
+			PG_RETURN_POINTER(JsonbValueToJsonb(&jbv));
+		case INT8OID:
+			jbv.type = jbvNumeric;
+			jbv.val.numeric = DatumGetNumeric(DirectFunctionCall1(int8_numeric, vi->data));
+			PG_RETURN_POINTER(JsonbValueToJsonb(&jbv));
+		case NUMERICOID:
+			/* jsonb has no NaN (or Infinity) */
+			if (numeric_is_nan(DatumGetNumeric(vi->data))
+#if PG_VERSION_NUM >= 140000
+					|| numeric_is_inf(DatumGetNumeric(vi->data))
+#endif
+				)
+				break;
+			jbv.type = jbvNumeric;
+			jbv.val.numeric = DatumGetNumeric(vi->data);
+			PG_RETURN_POINTER(JsonbValueToJsonb(&jbv));
+		case FLOAT4OID:
+		case FLOAT8OID:
+			{
+				double	f = vi->typid == FLOAT4OID ? DatumGetFloat4(vi->data) : DatumGetFloat8(vi->data);
 
-		if (ch == '"' || ch == '\\' ||
-			ch == '(' || ch == ')' || ch == ',' ||
-			isspace((unsigned char) ch))
-		{
-			need_quote = true;
+				if (isnan(f) || isinf(f))
+					break;
+
+				/*
+				 * float8_numeric() rounds to DBL_DIG digits, so go through the output
+				 * function like to_jsonb() does.
+				 */
+				jbv.type = jbvNumeric;
+				jbv.val.numeric = DatumGetNumeric(DirectFunctionCall3(numeric_in,
+							CStringGetDatum(OutputFunctionCall(&cache->proc, vi->data)),
+							ObjectIdGetDatum(InvalidOid),
+							Int32GetDatum(-1)));
+				PG_RETURN_POINTER(JsonbValueToJsonb(&jbv));
+			}
+		default:
 			break;
-		}
 	}
-	if(!need_quote)
-		appendStringInfoString(out, cache->formatted_name);
-	else
-	{
-		appendStringInfoChar(out, '"');
-		for (tmp = cache->formatted_name; *tmp; tmp++)
-		{
-			char		ch = *tmp;
 
-			if (ch == '"' || ch == '\\')
-				appendStringInfoCharMacro(out, ch);
-			appendStringInfoCharMacro(out, ch);
-		}
-		appendStringInfoChar(out, '"');
+	/* Tagged object */
+	{
+		JsonbParseState	*state = NULL;
+		JsonbValue			key;
+		JsonbValue			val;
+		JsonbValue			*res;
+
+		pushJsonbValue(&state, WJB_BEGIN_OBJECT, NULL);
+
+		key.type = jbvString;
+		key.val.string.val = "type";
+		key.val.string.len = strlen(key.val.string.val);
+		pushJsonbValue(&state, WJB_KEY, &key);
+		val.type = jbvString;
+		val.val.string.val = cache->formatted_name;
+		val.val.string.len = strlen(cache->formatted_name);
+		pushJsonbValue(&state, WJB_VALUE, &val);
+
+		key.val.string.val = "value";
+		key.val.string.len = strlen(key.val.string.val);
+		pushJsonbValue(&state, WJB_KEY, &key);
+		val.val.string.val = OutputFunctionCall(&cache->proc, vi->data);
+		val.val.string.len = strlen(val.val.string.val);
+		pushJsonbValue(&state, WJB_VALUE, &val);
+
+		res = pushJsonbValue(&state, WJB_END_OBJECT, NULL);
+		PG_RETURN_POINTER(JsonbValueToJsonb(res));
 	}
-	appendStringInfoChar(out, ',');
+}
 
-	if(!vi->isnull)
+/*
+ * variant_from_jsonb: Convert jsonb to a variant
+ *
+ * Arguments:
+ * 	jsonb
+ * 	Target typmod
+ */
+PG_FUNCTION_INFO_V1(variant_from_jsonb);
+Datum
+variant_from_jsonb(PG_FUNCTION_ARGS)
+{
+	Jsonb					*jb = (Jsonb *) PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
+	int						variant_typmod = PG_GETARG_INT32(1);
+	VariantInt		vi = palloc0(sizeof(*vi));
+	JsonbValue		*jbv;
+	JsonbValue		*type = NULL;
+	JsonbValue		*value = NULL;
+	JsonbValue		key;
+
+	Assert(fcinfo->flinfo->fn_strict); /* Must be strict */
+
+	vi->typmod = -1;
+
+	if (JB_ROOT_IS_OBJECT(jb) && JB_ROOT_COUNT(jb) == 2)
 	{
-		org_cstring = OutputFunctionCall(&cache->proc, vi->data);
+		key.type = jbvString;
+		key.val.string.val = "type";
+		key.val.string.len = strlen(key.val.string.val);
+		type = findJsonbValueFromContainer(&jb->root, JB_FOBJECT, &key);
+
+		key.val.string.val = "value";
+		key.val.string.len = strlen(key.val.string.val);
+		value = findJsonbValueFromContainer(&jb->root, JB_FOBJECT, &key);
 
 		/*
-		 * Detect whether we need double quotes for this value
-		 *
-		 * Stolen then modified from record_out.
+		 * Only treat it as tagged if variant_to_jsonb() could have produced it:
+		 * both members are strings, the type exists, and it's not a type that
+		 * would have been turned into a plain json value. Anything else is just
+		 * somebody's document that happens to look similar, so store the whole
+		 * thing.
 		 */
-		need_quote = (org_cstring[0] == '\0' ); /* force quotes for empty string */
-		if( !need_quote )
+		if (type == NULL || type->type != jbvString ||
+				value == NULL || value->type != jbvString)
+			type = NULL;
+		else
 		{
-			for (tmp = org_cstring; *tmp; tmp++)
-			{
-				char		ch = *tmp;
+			char		*type_name = pnstrdup(type->val.string.val, type->val.string.len);
+#if PG_VERSION_NUM >= 160000
+			ErrorSaveContext	escontext = {T_ErrorSaveContext};
 
-				if (ch == '"' || ch == '\\' ||
-					ch == '(' || ch == ')' || ch == ',' ||
-					isspace((unsigned char) ch))
-				{
-					need_quote = true;
+			if (!parseTypeString(type_name, &vi->typid, &vi->typmod, (Node *) &escontext))
+				vi->typid = InvalidOid;
+#else
+			parseTypeString(type_name, &vi->typid, &vi->typmod, true);
+#endif
+
+			switch (vi->typid)
+			{
+				case InvalidOid:
+				case JSONBOID:
+				case BOOLOID:
+				case INT2OID:
+				case INT4OID:
+				case INT8OID:
+				case TEXTOID:
+				case VARCHAROID:
+				case BPCHAROID:
+					type = NULL;
+					vi->typmod = -1;
+					break;
+				default:
 					break;
-				}
 			}
 		}
+	}
 
-		if (!need_quote)
-			appendStringInfoString(out, org_cstring);
-		else
+	/* A tagged object's value is converted below, once we know it's allowed */
+	if (type == NULL && JB_ROOT_IS_SCALAR(jb))
+	{
+		jbv = getIthJsonbValueFromContainer(&jb->root, 0);
+		switch (jbv->type)
 		{
-			appendStringInfoChar(out, '"');
-			for (tmp = org_cstring; *tmp; tmp++)
-			{
-				char		ch = *tmp;
-
-				if (ch == '"' || ch == '\\')
-					appendStringInfoCharMacro(out, ch);
-				appendStringInfoCharMacro(out, ch);
-			}
-			appendStringInfoChar(out, '"');
+			case jbvNull:
+				PG_RETURN_NULL();
+			case jbvString:
+				vi->typid = TEXTOID;
+				vi->data = PointerGetDatum(cstring_to_text_with_len(jbv->val.string.val, jbv->val.string.len));
+				break;
+			case jbvNumeric:
+				vi->typid = NUMERICOID;
+				vi->data = NumericGetDatum(jbv->val.numeric);
+				break;
+			case jbvBool:
+				vi->typid = BOOLOID;
+				vi->data = BoolGetDatum(jbv->val.boolean);
+				break;
+			default:
+				elog(ERROR, "unexpected jsonb scalar type %d", jbv->type);
 		}
 	}
+	else if (type == NULL)
+	{
+		vi->typid = JSONBOID;
+		vi->data = PointerGetDatum(jb);
+	}
 
-	appendStringInfoChar(out, ')');
+	/* Verify we've been handed a valid typmod */
+	variant_check_type(variant_typmod, vi->typid);
+
+	if (type != NULL)
+	{
+		VariantCache	*cache = get_cache(fcinfo, vi, IOFunc_input);
+
+		vi->data = InputFunctionCall(&cache->proc,
+				pnstrdup(value->val.string.val, value->val.string.len),
+				cache->typioparam, vi->typmod);
+	}
 
-	return out->data;
+	PG_RETURN_VARIANT(variant_pack(make_variant(vi, fcinfo, IOFunc_input), variant_typmod));
 }
+#endif
 
 /*
- * variant_get_variant_name: Return the name of a named variant
+ * CBOR
+ *
+ * Each variant is encoded as a CBOR (RFC 8949) array of two items: the
+ * original type, then the value. The type is an unsigned integer holding the
+ * type Oid for built-in types without a type modifier, otherwise a text
+ * string as produced by format_type(). Built-in Oids never change, but other
+ * Oids mean nothing outside this database.
+ *
+ * bool, int2/4/8, float4/8, text, varchar, char and bytea values use the
+ * native CBOR encoding; anything else is a text string holding the output of
+ * the type's output function. A NULL value is CBOR null.
+ *
+ * The array and aggregate forms produce a CBOR array of those, with NULL
+ * variants as CBOR null.
  */
-char *
-variant_get_variant_name(int typmod, Oid org_typid, bool ignore_storage)
+PG_FUNCTION_INFO_V1(variant_to_cbor);
+Datum
+variant_to_cbor(PG_FUNCTION_ARGS)
 {
-	Datum						values[2];
-	MemoryContext		cctx = CurrentMemoryContext;
-	bool						do_pop = _SPI_conn();
-	bool						isnull;
-	Oid							types[2] = {INT4OID, REGTYPEOID};
-	char						*cmd;
-	int							nargs;
-	int							ret;
-	Datum						result;
-	char						*out;
-
-	values[0] = Int32GetDatum(typmod);
+	StringInfoData	buf;
 
-	/*
-	 * There's a race condition here; someone could be attempting to remove an
-	 * allowed type from this registered variant or even remove it entirely. We
-	 * could avoid that by taking a share/keyshare lock here and taking the
-	 * appropriate blocking lock when modifying the registration record. Doing
-	 * that would probably be quite bad though; not only are type IO and typmod
-	 * IO routines assumed to be non-volatile, taking such a lock would end up
-	 * generating a lot of lock updates to the registration rows.
-	 *
-	 * Since the whole purpose of registration is to handle the issue of someone
-	 * attempting to drop a type that has made it into a variant in a table
-	 * column, which we can't completely handle anyway, I don't think it's worth
-	 * it to lock the rows.
-	 */
-	if(ignore_storage)
-	{
-		cmd = "SELECT variant_name, variant_enabled, storage_allowed FROM variant._registered WHERE variant_typmod = $1";
-		nargs = 1;
-	}
-	else
-	{
-		cmd = "SELECT variant_name, variant_enabled, storage_allowed, allowed_types @> array[ $2 ] FROM variant._registered WHERE variant_typmod = $1";
-		nargs = 2;
-		values[1] = ObjectIdGetDatum(org_typid);
-	}
+	Assert(fcinfo->flinfo->fn_strict); /* Must be strict */
 
-	/* command, nargs, Oid *argument_types, *values, *nulls, read_only, count */
-	if( (ret = SPI_execute_with_args( cmd, nargs, types, values, "  ", true, 0 )) != SPI_OK_SELECT )
-		elog( ERROR, "SPI_execute_with_args(%s) returned %s", cmd, SPI_result_code_string(ret));
-	Assert( SPI_tuptable );
+	initStringInfo(&buf);
+	cbor_put_variant(fcinfo, &buf, PG_GETARG_VARIANT(0));
 
-	if ( SPI_processed > 1 )
-		ereport(ERROR,
-			( errmsg( "Got %u records for variant typmod %i", SPI_processed, typmod ),
-				errhint( "This means _variant._registered is corrupted" )
-			)
-		);
-	if ( SPI_processed < 1 )
-		elog( ERROR, "invalid typmod %i", typmod );
+	PG_RETURN_BYTEA_P(cbor_to_bytea(&buf));
+}
 
-	/* Note 0 vs 1 based numbering */
-	Assert(SPI_tuptable->tupdesc->attrs[0]->atttypid == VARCHAROID);
-	Assert(SPI_tuptable->tupdesc->attrs[1]->atttypid == BOOLOID);
-	Assert(SPI_tuptable->tupdesc->attrs[2]->atttypid == BOOLOID);
-	result = heap_getattr( SPI_tuptable->vals[0], 1, SPI_tuptable->tupdesc, &isnull );
-	if( isnull )
-		ereport( ERROR,
-				( errmsg( "Found NULL variant_name for typmod %i", typmod ),
-					errhint( "This should never happen; is _variant._registered corrupted?" )
-				)
-		);
+PG_FUNCTION_INFO_V1(variant_array_to_cbor);
+Datum
+variant_array_to_cbor(PG_FUNCTION_ARGS)
+{
+	ArrayType				*arr = PG_GETARG_ARRAYTYPE_P(0);
+	StringInfoData	buf;
+	Datum						*elems;
+	bool						*nulls;
+	int							nelems;
+	int							i;
+	int16						typlen;
+	bool						typbyval;
+	char						typalign;
 
-	MemoryContextSwitchTo(cctx);
-	out = text_to_cstring(DatumGetTextP(result));
+	Assert(fcinfo->flinfo->fn_strict); /* Must be strict */
 
-	result = heap_getattr( SPI_tuptable->vals[0], 2, SPI_tuptable->tupdesc, &isnull );
-	if( !DatumGetBool(result) )
-		ereport( ERROR,
-				( errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-					errmsg( "variant.variant(%s) is disabled", out )
-				)
-			);
+	get_typlenbyvalalign(ARR_ELEMTYPE(arr), &typlen, &typbyval, &typalign);
+	deconstruct_array(arr, ARR_ELEMTYPE(arr), typlen, typbyval, typalign,
+					  &elems, &nulls, &nelems);
 
-	/*
-	 * If storage is allowed, then throw an error if we don't know what our
-	 * original type is, or if that type is not listed as allowed.
-	 */
-	if(!ignore_storage)
+	initStringInfo(&buf);
+	cbor_put_head(&buf, CBOR_ARRAY, nelems);
+	for (i = 0; i < nelems; i++)
 	{
-		result = heap_getattr( SPI_tuptable->vals[0], 3, SPI_tuptable->tupdesc, &isnull );
-		if( DatumGetBool(result) )
-		{
-			if( org_typid == InvalidOid)
-				ereport( ERROR,
-						( errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-							errmsg( "Unable to determine original type" )
-						)
-					);
-
-			result = heap_getattr( SPI_tuptable->vals[0], 4, SPI_tuptable->tupdesc, &isnull );
-			if( !DatumGetBool(result) )
-				ereport( ERROR,
-						( errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-							errmsg( "type %s is not allowed in variant.variant(%s)", format_type_be(org_typid), out ),
-							errhint( "you can permanently allow a type to be used by calling variant.allow_type()" )
-						)
-					);
-		}
+		if (nulls[i])
+			appendStringInfoCharMacro(&buf, CBOR_NULL);
+		else
+			cbor_put_variant(fcinfo, &buf, DatumGetVariantType(elems[i]));
 	}
 
-	_SPI_disc(do_pop); /* pfree's all SPI stuff */
-
-	return out;
+	PG_RETURN_BYTEA_P(cbor_to_bytea(&buf));
 }
 
 /*
- * variant_cmp_int: Compare two variants
+ * variant_cbor_agg_transfn: Append a variant to an indefinite length array
+ *
+ * The buffer lives in the aggregate context, so this works the same way
+ * array_agg does.
  */
-static int
-variant_cmp_int(FunctionCallInfo fcinfo)
+PG_FUNCTION_INFO_V1(variant_cbor_agg_transfn);
+Datum
+variant_cbor_agg_transfn(PG_FUNCTION_ARGS)
 {
-	Variant			l, r;
-	VariantInt	li;
-	VariantInt	ri;
-	int					out;
-	
-	Assert(fcinfo->flinfo->fn_strict); /* Must not be callable on NULL input */
-	l = PG_GETARG_VARIANT(0);
-	r = PG_GETARG_VARIANT(1);
+	MemoryContext		aggcontext;
+	MemoryContext		oldcontext;
+	StringInfo			state;
 
-	/*
-	 * Presumably if both inputs are binary equal then they are in fact equal.
-	 * The only problem is two variants storing NULL would be binary equal but
-	 * can't be treated as-such. Given that issue, it doesn't seem worth trying
-	 * to optimize this.
-	 *
-	 * Note that we're not trying to play tricks with not detoasting or
-	 * un-packing, unlike variant_image_eq().
-	 */
-#ifdef NOT_USED
-	if(VARSIZE(l) == VARSIZE(r)
-			&& memcmp(l, r, VARSIZE(l)) == 0)
-		return 0;
-#endif
+	Assert(!fcinfo->flinfo->fn_strict); /* Must be callable on NULL input */
 
-	/*
-	 * We don't care about IO function but must specify something
-	 *
-	 * TODO: Improve caching so it will handle more than just one type :(
-	 */
-	li = make_variant_int(l, fcinfo, IOFunc_input);
-	ri = make_variant_int(r, fcinfo, IOFunc_input);
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+		elog(ERROR, "variant_cbor_agg_transfn called in non-aggregate context");
 
-	/*
-	 * We need to special-case IS DISTINCT, because it considers NULL to be the
-	 * same as NULL.
-	 */
-	if(fcinfo->flinfo->fn_expr &&
-			IsA(fcinfo->flinfo->fn_expr, DistinctExpr))
+	if (PG_ARGISNULL(0))
 	{
-		if( li->isnull && ri->isnull )
-			return 0;
-		else if( li->isnull || ri->isnull )
-			return -1;
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+		state = makeStringInfo();
+		MemoryContextSwitchTo(oldcontext);
+		appendStringInfoCharMacro(state, CBOR_ARRAY << 5 | CBOR_INDEFINITE);
 	}
-	else if(li->isnull || ri->isnull )
-		PG_RETURN_NULL();
+	else
+		state = (StringInfo) PG_GETARG_POINTER(0);
 
-	/* TODO: If both variants are of the same type try comparing directly */
-		/* TODO: Support Transform_null_equals */
+	if (PG_ARGISNULL(1))
+		appendStringInfoCharMacro(state, CBOR_NULL);
+	else /* repalloc keeps the buffer in aggcontext */
+		cbor_put_variant(fcinfo, state, PG_GETARG_VARIANT(1));
 
-	/* Do comparison via SPI */
-	/* TODO: cache this */
-	{
-		bool				do_pop;
-		int					ret;
-		char				*cmd;
-		Oid					types[2];
-		Datum				values[2];
-		bool				nulls[2];
+	PG_RETURN_POINTER(state);
+}
 
-		do_pop = _SPI_conn();
+PG_FUNCTION_INFO_V1(variant_cbor_agg_finalfn);
+Datum
+variant_cbor_agg_finalfn(PG_FUNCTION_ARGS)
+{
+	StringInfo	state;
+	bytea				*out;
 
-		cmd = "SELECT CASE WHEN $1 = $2 THEN 0 WHEN $1 < $2 THEN -1 ELSE 1 END::int";
-		types[0] = li->typid;
-		values[0] = li->data;
-		nulls[0] = li->isnull;
-		types[1] = ri->typid;
-		values[1] = ri->data;
-		nulls[1] = ri->isnull;
+	Assert(AggCheckCallContext(fcinfo, NULL));
 
-		if( (ret = SPI_execute_with_args(
-						cmd, 2, types, values, nulls,
-						true, /* read-only */
-						0 /* count */
-					)) != SPI_OK_SELECT )
-			elog( ERROR, "SPI_execute_with_args returned %s", SPI_result_code_string(ret));
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+	state = (StringInfo) PG_GETARG_POINTER(0);
 
-		/* Note 0 vs 1 based numbering */
-		Assert(SPI_tuptable->tupdesc->attrs[0]->atttypid == INT4OID);
+	/* We can be called more than once, so don't touch state */
+	out = palloc(VARHDRSZ + state->len + 1);
+	SET_VARSIZE(out, VARHDRSZ + state->len + 1);
+	memcpy(VARDATA(out), state->data, state->len);
+	*((char *) VARDATA(out) + state->len) = CBOR_BREAK;
 
-		/* Don't need to copy the tuple because int is pass by value */
-		out = DatumGetInt32( heap_getattr(SPI_tuptable->vals[0], 1, SPI_tuptable->tupdesc, &fcinfo->isnull) );
+	PG_RETURN_BYTEA_P(out);
+}
 
-		_SPI_disc(do_pop);
-	}
+/*
+ * variant_from_cbor: Decode one variant
+ *
+ * Arguments:
+ * 	CBOR, as produced by variant_to_cbor
+ * 	Target typmod
+ */
+PG_FUNCTION_INFO_V1(variant_from_cbor);
+Datum
+variant_from_cbor(PG_FUNCTION_ARGS)
+{
+	bytea				*in = PG_GETARG_BYTEA_PP(0);
+	CborReader	r;
+	bool				isnull;
+	Datum				out;
 
-	return out;
+	Assert(fcinfo->flinfo->fn_strict); /* Must be strict */
+
+	r.p = (uint8 *) VARDATA_ANY(in);
+	r.end = r.p + VARSIZE_ANY_EXHDR(in);
+
+	out = cbor_get_variant(fcinfo, &r, PG_GETARG_INT32(1), &isnull);
+	if (r.p != r.end)
+		ereport(ERROR,
+				( errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+					errmsg( "invalid variant CBOR: %d bytes of trailing data", (int) (r.end - r.p) )
+				)
+			);
+
+	if (isnull)
+		PG_RETURN_NULL();
+	PG_RETURN_DATUM(out);
 }
 
 /*
- * make_variant_int: Converts our external (Variant) representation to a VariantInt.
+ * variant_array_from_cbor: Decode an array of variants
  */
-static VariantInt
-make_variant_int(Variant v, FunctionCallInfo fcinfo, IOFuncSelector func)
+PG_FUNCTION_INFO_V1(variant_array_from_cbor);
+Datum
+variant_array_from_cbor(PG_FUNCTION_ARGS)
 {
-	VariantCache	*cache;
-	VariantInt		vi;
-	long 					data_length; /* long instead of size_t because we're subtracting */
-	Pointer 			ptr;
-	uint					flags;
-
-	
-	/* Ensure v is fully detoasted */
-	Assert(!VARATT_IS_EXTENDED(v));
+	bytea				*in = PG_GETARG_BYTEA_PP(0);
+	int					variant_typmod = PG_GETARG_INT32(1);
+	Oid					elemtype = get_element_type(get_fn_expr_rettype(fcinfo->flinfo));
+	CborReader	r;
+	uint64			count;
+	bool				indefinite;
+	Datum				*elems;
+	bool				*nulls;
+	int					nelems = 0;
+	int					alloc;
+	int					dims[1];
+	int					lbs[1] = {1};
+	int16				typlen;
+	bool				typbyval;
+	char				typalign;
 
-	/* May need to be careful about what context this stuff is palloc'd in */
-	vi = palloc0(sizeof(VariantDataInt));
+	Assert(fcinfo->flinfo->fn_strict); /* Must be strict */
 
-	vi->typid = get_oid(v, &flags);
+	if (!OidIsValid(elemtype))
+		elog(ERROR, "could not determine element type of result");
 
-#ifdef VARIANT_TEST_OID
-	vi->typid -= OID_MASK;
-#endif
+	r.p = (uint8 *) VARDATA_ANY(in);
+	r.end = r.p + VARSIZE_ANY_EXHDR(in);
 
-	vi->typmod = v->typmod;
-	vi->isnull = (flags & VAR_ISNULL ? true : false);
+	if (cbor_get_head(&r, &count, &indefinite) != CBOR_ARRAY)
+		ereport(ERROR,
+				( errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+					errmsg( "invalid variant CBOR: expected an array" )
+				)
+			);
 
-	cache = get_cache(fcinfo, vi, func);
+	/* Don't trust count for the allocation; every item is at least 1 byte */
+	alloc = indefinite ? 16 : Min(count, (uint64) (r.end - r.p)) + 1;
+	elems = palloc(sizeof(Datum) * alloc);
+	nulls = palloc(sizeof(bool) * alloc);
 
-	/*
-	 * by-value type. We do special things with all pass-by-reference when we
-	 * store, so we only use this for typbyval even though fetch_att supports
-	 * pass-by-reference.
-	 *
-	 * Note that fetch_att sanity-checks typlen for us (because we're only passing typbyval).
-	 */
-	if(cache->typbyval)
+	while (indefinite ? !cbor_at_break(&r) : nelems < count)
 	{
-		if(!vi->isnull)
+		if (nelems >= alloc)
 		{
-			Pointer p = VDATAPTR_ALIGN(v, cache->typalign);
-			vi->data = fetch_att(p, cache->typbyval, cache->typlen);
+			alloc *= 2;
+			elems = repalloc(elems, sizeof(Datum) * alloc);
+			nulls = repalloc(nulls, sizeof(bool) * alloc);
 		}
-		return vi;
+		elems[nelems] = cbor_get_variant(fcinfo, &r, variant_typmod, &nulls[nelems]);
+		nelems++;
 	}
+	if (r.p != r.end)
+		ereport(ERROR,
+				( errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+					errmsg( "invalid variant CBOR: %d bytes of trailing data", (int) (r.end - r.p) )
+				)
+			);
 
-	/* we don't store a varlena header for varlena data; instead we compute
-	 * it's size based on ours:
-	 *
-	 * Our size - our header size - overflow byte (if present)
-	 *
-	 * For cstring, we don't store the trailing NUL
-	 */
+	get_typlenbyvalalign(elemtype, &typlen, &typbyval, &typalign);
+	dims[0] = nelems;
+	if (nelems == 0)
+		PG_RETURN_ARRAYTYPE_P(construct_empty_array(elemtype));
+	PG_RETURN_ARRAYTYPE_P(construct_md_array(elems, nulls, 1, dims, lbs,
+				elemtype, typlen, typbyval, typalign));
+}
+
+/*
+ * variant_registered_inval: Trigger on _variant._registered
+ *
+ * Sends a relcache invalidation for _variant._registered, so every backend
+ * (including ours) throws away its registered variant cache. See
+ * registry_lookup().
+ */
+PG_FUNCTION_INFO_V1(variant_registered_inval);
+Datum
+variant_registered_inval(PG_FUNCTION_ARGS)
+{
+	TriggerData	*trigdata = (TriggerData *) fcinfo->context;
+
+	if (!CALLED_AS_TRIGGER(fcinfo))
+		elog(ERROR, "variant_registered_inval: not called by trigger manager");
+
+	CacheInvalidateRelcache(trigdata->tg_relation);
+
+	return PointerGetDatum(NULL);
+}
+
+/*
+ * variant_intern_trigger: BEFORE INSERT OR UPDATE row trigger, variant.intern()
+ *
+ * Interns large payloads in every variant column whose registered variant has
+ * an intern_threshold. This is the only place we intern, so a row in
+ * _variant._interned commits or rolls back with the row that references it,
+ * and values that are never stored don't write anything. See
+ * variant_intern().
+ */
+PG_FUNCTION_INFO_V1(variant_intern_trigger);
+Datum
+variant_intern_trigger(PG_FUNCTION_ARGS)
+{
+	TriggerData	*trigdata = (TriggerData *) fcinfo->context;
+	HeapTuple		tuple;
+#if PG_VERSION_NUM >= 110000
+	TupleDesc		tupdesc;
+	Oid					variant_oid;
+	Datum				*values;
+	bool				*nulls;
+	bool				*replace;
+	bool				changed = false;
+	int					i;
+#endif
+
+	if (!CALLED_AS_TRIGGER(fcinfo))
+		elog(ERROR, "variant_intern_trigger: not called by trigger manager");
+	if (!TRIGGER_FIRED_BEFORE(trigdata->tg_event)
+			|| !TRIGGER_FIRED_FOR_ROW(trigdata->tg_event)
+			|| TRIGGER_FIRED_BY_DELETE(trigdata->tg_event))
+		ereport(ERROR,
+				( errcode(ERRCODE_E_R_I_E_TRIGGER_PROTOCOL_VIOLATED),
+					errmsg( "variant.intern() must be fired BEFORE INSERT OR UPDATE FOR EACH ROW" )
+				)
+			);
+
+	tuple = TRIGGER_FIRED_BY_UPDATE(trigdata->tg_event) ? trigdata->tg_newtuple : trigdata->tg_trigtuple;
+
+#if PG_VERSION_NUM >= 110000
+	tupdesc = trigdata->tg_relation->rd_att;
+	variant_oid = TypenameNspGetTypid("variant", get_namespace_oid("variant", false));
+	values = palloc(tupdesc->natts * sizeof(Datum));
+	nulls = palloc(tupdesc->natts * sizeof(bool));
+	replace = palloc0(tupdesc->natts * sizeof(bool));
+	heap_deform_tuple(tuple, tupdesc, values, nulls);
+
+	for (i = 0; i < tupdesc->natts; i++)
+	{
+		Form_pg_attribute	att = TupleDescAttr(tupdesc, i);
+		struct varlena		*v;
+		Variant						out;
+
+		if (att->attisdropped || att->atttypid != variant_oid || att->atttypmod < 0 || nulls[i])
+			continue;
+		if (registry_lookup(att->atttypmod)->intern_threshold <= 0)
+			continue;
+
+		v = PG_DETOAST_DATUM(values[i]);
+		if (variant_is_compact(v))
+			continue;
+		if (variant_is_interned(v))
+		{
+			intern_ensure_stored(v);
+			continue;
+		}
+
+		out = variant_intern((Variant) v, att->atttypmod);
+		if (out != (Variant) v)
+		{
+			values[i] = VariantTypeGetDatum(out);
+			replace[i] = true;
+			changed = true;
+		}
+	}
+
+	if (changed)
+		tuple = heap_modify_tuple(tuple, tupdesc, values, nulls, replace);
+#endif
+
+	return PointerGetDatum(tuple);
+}
+
+/*
+ * TEXT ARRAYS
+ *
+ * variant_from_text_array() builds variants straight from the text form of
+ * each value and a separate array of types, ie: what an ETL tool gets from a
+ * CSV file with a type for each column. There's no "(type,value)" wrapper to
+ * build or parse, and everything we need to know about each type is looked up
+ * once per call instead of once per value.
+ */
+typedef struct TextArrayType
+{
+	Oid							typid;			/* hash key */
+	Oid							typioparam;
+	int16						typlen;
+	bool						typbyval;
+	char						typalign;
+	FmgrInfo				proc;
+} TextArrayType;
+
+/*
+ * variant_from_text_array: Build an array of variants from text values and types
+ *
+ * 	Values; a NULL value becomes a variant with a NULL payload
+ * 	Types; must have the same number of elements as values
+ * 	Target typmod
+ */
+PG_FUNCTION_INFO_V1(variant_from_text_array);
+Datum
+variant_from_text_array(PG_FUNCTION_ARGS)
+{
+	ArrayType			*values = PG_GETARG_ARRAYTYPE_P(0);
+	ArrayType			*types = PG_GETARG_ARRAYTYPE_P(1);
+	int						variant_typmod = PG_GETARG_INT32(2);
+	Oid						elemtype = get_element_type(get_fn_expr_rettype(fcinfo->flinfo));
+	Datum					*value_elems;
+	bool					*value_nulls;
+	Datum					*type_elems;
+	bool					*type_nulls;
+	int						nvalues;
+	int						ntypes;
+	Datum					*out;
+	HTAB					*type_info;
+	HASHCTL				ctl;
+	MemoryContext	scratch;
+	MemoryContext	oldcxt;
+	int						dims[1];
+	int						lbs[1] = {1};
+	int16					typlen;
+	bool					typbyval;
+	char					typalign;
+	int						i;
+
+	Assert(fcinfo->flinfo->fn_strict); /* Must be strict */
+
+	if (!OidIsValid(elemtype))
+		elog(ERROR, "could not determine element type of result");
+
+	deconstruct_array(values, TEXTOID, -1, false, 'i',
+					  &value_elems, &value_nulls, &nvalues);
+	deconstruct_array(types, REGTYPEOID, sizeof(Oid), true, 'i',
+					  &type_elems, &type_nulls, &ntypes);
+	if (nvalues != ntypes)
+		ereport(ERROR,
+				( errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+					errmsg( "got %d values but %d types", nvalues, ntypes )
+				)
+			);
+
+	if (nvalues == 0)
+		PG_RETURN_ARRAYTYPE_P(construct_empty_array(elemtype));
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(Oid);
+	ctl.entrysize = sizeof(TextArrayType);
+	ctl.hash = tag_hash;
+	ctl.hcxt = CurrentMemoryContext;
+	type_info = hash_create("variant text array types", 16, &ctl,
+			HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	out = palloc(sizeof(Datum) * nvalues);
+	scratch = get_scratch(fcinfo);
+
+	for (i = 0; i < nvalues; i++)
+	{
+		VariantDataInt	vid;
+		TextArrayType		*t;
+		Oid							typid;
+		bool						found;
+
+		if (type_nulls[i])
+			ereport(ERROR,
+					( errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+						errmsg( "type %d must not be NULL", i + 1 )
+					)
+				);
+		typid = DatumGetObjectId(type_elems[i]);
+
+		t = hash_search(type_info, &typid, HASH_ENTER, &found);
+		if (!found)
+		{
+			char		typdelim;
+			Oid			typIoFunc;
+
+			/* Verify we've been handed a valid typmod */
+			variant_check_type(variant_typmod, typid);
+
+			get_type_io_data(typid, IOFunc_input,
+							 &t->typlen, &t->typbyval, &t->typalign,
+							 &typdelim, &t->typioparam, &typIoFunc);
+			fmgr_info(typIoFunc, &t->proc);
+		}
+		else if (bulk_load)
+			/* Only to keep the bulk load counts right */
+			variant_check_type(variant_typmod, typid);
+
+		MemSet(&vid, 0, sizeof(vid));
+		vid.typid = typid;
+		vid.typmod = -1;
+		vid.isnull = value_nulls[i];
+
+		/* Input garbage goes in scratch; make_variant_typ() copies the result */
+		oldcxt = MemoryContextSwitchTo(scratch);
+		if (!vid.isnull)
+			vid.data = InputFunctionCall(&t->proc, TextDatumGetCString(value_elems[i]),
+										 t->typioparam, -1);
+		MemoryContextSwitchTo(oldcxt);
+
+		out[i] = PointerGetDatum(variant_pack(make_variant_typ(&vid, t->typlen, t->typbyval, t->typalign),
+											  variant_typmod));
+		MemoryContextReset(scratch);
+	}
+
+	hash_destroy(type_info);
+
+	get_typlenbyvalalign(elemtype, &typlen, &typbyval, &typalign);
+	dims[0] = nvalues;
+	PG_RETURN_ARRAYTYPE_P(construct_md_array(out, NULL, 1, dims, lbs,
+				elemtype, typlen, typbyval, typalign));
+}
+
+/*
+ * SORT KEYS
+ *
+ * variant_sort_key() encodes a variant as a string of bytes whose memcmp()
+ * order is the order of the variants: first by original type Oid (the same
+ * type order as btree__variant_type_ops), then by value. Two variants of the
+ * same type compare the same way their keys do, which is what
+ * variant_cmp_int() does for them. (variant_cmp_int() can also compare
+ * values of different types; keys can not.)
+ *
+ * The type modifier is not part of the key; variant_cmp_int() ignores it too.
+ * A NULL value sorts after every other value of the same type.
+ *
+ * Strings are ordered bytewise, which is what the "C" collation does.
+ *
+ * If prefix_len is given the key is truncated to that many bytes. Truncated
+ * keys are still in order, but keys that compare equal may not be.
+ */
+PG_FUNCTION_INFO_V1(variant_sort_key);
+Datum
+variant_sort_key(PG_FUNCTION_ARGS)
+{
+	Variant					v = PG_GETARG_VARIANT(0);
+	VariantInt			vi;
+	StringInfoData	buf;
+	bytea						*out;
+	int							len;
+
+	Assert(fcinfo->flinfo->fn_strict); /* Must be strict */
+
+	/* We don't care about IO function but must specify something */
+	vi = make_variant_int(v, fcinfo, IOFunc_input);
+
+	initStringInfo(&buf);
+	sort_key_put_variant(&buf, vi);
+
+	len = buf.len;
+	if (PG_NARGS() > 1)
+	{
+		int		prefix_len = PG_GETARG_INT32(1);
+
+		if (prefix_len < 1)
+			ereport(ERROR,
+					( errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg( "prefix length must be at least 1" )
+					)
+				);
+		len = Min(len, prefix_len);
+	}
+
+	out = palloc(VARHDRSZ + len);
+	SET_VARSIZE(out, VARHDRSZ + len);
+	memcpy(VARDATA(out), buf.data, len);
+	pfree(buf.data);
+
+	PG_RETURN_BYTEA_P(out);
+}
+
+/*
+ * variant_bench: Time one of our internal routines
+ *
+ * This is for testing only. It runs op iterations times against sample,
+ * entirely in C, and returns nanoseconds per call and bytes palloc'd per call.
+ * That takes the executor out of the picture, which makes it possible to pin a
+ * performance change on a specific routine.
+ *
+ * Every op gets its own FmgrInfo, so the type cache behaves like it would for
+ * a real call site. Memory used by the op is released every BENCH_RESET_EVERY
+ * iterations; that's included in the timing.
+ *
+ * Measuring memory requires MemoryContextMemAllocated(), so bytes_per_op is
+ * NULL before 13.0. It counts allocated blocks, so it's approximate.
+ */
+typedef enum
+{
+	BENCH_MAKE_VARIANT,
+	BENCH_MAKE_VARIANT_INT,
+	BENCH_OUT,
+	BENCH_IN,
+	BENCH_CMP,
+	BENCH_HASH
+} BenchOp;
+
+#define BENCH_RESET_EVERY		1024
+
+static void bench_one(BenchOp op, FunctionCallInfo fcinfo, Variant sample,
+		VariantInt vi, char *sample_cstring);
+
+PG_FUNCTION_INFO_V1(variant_bench);
+Datum
+variant_bench(PG_FUNCTION_ARGS)
+{
+	char							*opname = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	Variant						sample = PG_GETARG_VARIANT(1);
+	int								iterations = PG_GETARG_INT32(2);
+	BenchOp						op;
+	MemoryContext			cctx = CurrentMemoryContext;
+	MemoryContext			cache_cxt;
+	MemoryContext			op_cxt;
+	FmgrInfo					flinfo;
+#if PG_VERSION_NUM >= 120000
+	LOCAL_FCINFO(locfcinfo, 2);
+#else
+	FunctionCallInfoData	locfcinfo_data;
+	FunctionCallInfo	locfcinfo = &locfcinfo_data;
+#endif
+	VariantInt				vi = NULL;
+	char							*sample_cstring = NULL;
+#if PG_VERSION_NUM >= 130000
+	Size							allocated;
+#endif
+	instr_time				start;
+	instr_time				duration;
+	int								i;
+	TupleDesc					tupdesc;
+	Datum							values[2];
+	bool							nulls[2] = {false, false};
+
+	Assert(fcinfo->flinfo->fn_strict); /* Must be strict */
+
+	if (strcmp(opname, "make_variant") == 0)
+		op = BENCH_MAKE_VARIANT;
+	else if (strcmp(opname, "make_variant_int") == 0)
+		op = BENCH_MAKE_VARIANT_INT;
+	else if (strcmp(opname, "variant_out_int") == 0)
+		op = BENCH_OUT;
+	else if (strcmp(opname, "variant_in_int") == 0)
+		op = BENCH_IN;
+	else if (strcmp(opname, "variant_cmp_int") == 0)
+		op = BENCH_CMP;
+	else if (strcmp(opname, "variant_hash") == 0)
+		op = BENCH_HASH;
+	else
+		ereport(ERROR,
+				( errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg( "unknown benchmark operation \"%s\"", opname ),
+					errhint( "valid operations are make_variant, make_variant_int, variant_out_int, variant_in_int, variant_cmp_int and variant_hash" )
+				)
+			);
+
+	if (iterations < 1)
+		ereport(ERROR,
+				( errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg( "iterations must be at least 1" )
+				)
+			);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/* The type cache must survive resetting op_cxt */
+	cache_cxt = AllocSetContextCreate(cctx, "variant bench cache",
+			ALLOCSET_DEFAULT_MINSIZE, ALLOCSET_DEFAULT_INITSIZE, ALLOCSET_DEFAULT_MAXSIZE);
+	op_cxt = AllocSetContextCreate(cctx, "variant bench",
+			ALLOCSET_DEFAULT_MINSIZE, ALLOCSET_DEFAULT_INITSIZE, ALLOCSET_DEFAULT_MAXSIZE);
+
+	MemSet(&flinfo, 0, sizeof(flinfo));
+	flinfo.fn_strict = true;
+	flinfo.fn_nargs = 2;
+	flinfo.fn_mcxt = cache_cxt;
+	InitFunctionCallInfoData(*locfcinfo, &flinfo, 2, InvalidOid, NULL, NULL);
+#if PG_VERSION_NUM >= 120000
+	locfcinfo->args[0].value = VariantTypeGetDatum(sample);
+	locfcinfo->args[1].value = VariantTypeGetDatum(sample);
+	locfcinfo->args[0].isnull = false;
+	locfcinfo->args[1].isnull = false;
+#else
+	locfcinfo->arg[0] = VariantTypeGetDatum(sample);
+	locfcinfo->arg[1] = VariantTypeGetDatum(sample);
+	locfcinfo->argnull[0] = false;
+	locfcinfo->argnull[1] = false;
+#endif
+
+	/* Set up whatever input the op needs, using a different FmgrInfo */
+	MemoryContextSwitchTo(cache_cxt);
+	if (op == BENCH_MAKE_VARIANT || op == BENCH_IN)
+	{
+		FmgrInfo					setup_flinfo = flinfo;
+#if PG_VERSION_NUM >= 120000
+		LOCAL_FCINFO(setup_fcinfo, 2);
+
+		memcpy(setup_fcinfo, locfcinfo, SizeForFunctionCallInfo(2));
+#else
+		FunctionCallInfoData	setup_fcinfo_data = *locfcinfo;
+		FunctionCallInfo	setup_fcinfo = &setup_fcinfo_data;
+#endif
+
+		setup_fcinfo->flinfo = &setup_flinfo;
+		if (op == BENCH_MAKE_VARIANT)
+			vi = make_variant_int(sample, setup_fcinfo, IOFunc_input);
+		else
+			sample_cstring = variant_out_int(setup_fcinfo,
+					make_variant_int(sample, setup_fcinfo, IOFunc_output));
+	}
+
+	/*
+	 * Warm the cache, and measure memory. Some ops allocate in fn_mcxt, so we
+	 * need to look at both contexts.
+	 */
+	MemoryContextSwitchTo(op_cxt);
+#if PG_VERSION_NUM >= 130000
+	allocated = MemoryContextMemAllocated(op_cxt, true) + MemoryContextMemAllocated(cache_cxt, true);
+#endif
+	for (i = 0; i < Min(iterations, BENCH_RESET_EVERY); i++)
+		bench_one(op, locfcinfo, sample, vi, sample_cstring);
+#if PG_VERSION_NUM >= 130000
+	allocated = MemoryContextMemAllocated(op_cxt, true) + MemoryContextMemAllocated(cache_cxt, true) - allocated;
+	values[1] = Float8GetDatum( (double) allocated / i );
+#else
+	nulls[1] = true;
+#endif
+	MemoryContextReset(op_cxt);
+
+	INSTR_TIME_SET_CURRENT(start);
+	for (i = 0; i < iterations; i++)
+	{
+		bench_one(op, locfcinfo, sample, vi, sample_cstring);
+
+		if (i % BENCH_RESET_EVERY == BENCH_RESET_EVERY - 1)
+		{
+			MemoryContextReset(op_cxt);
+			CHECK_FOR_INTERRUPTS();
+		}
+	}
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+
+	MemoryContextSwitchTo(cctx);
+	MemoryContextDelete(op_cxt);
+	MemoryContextDelete(cache_cxt);
+
+	values[0] = Float8GetDatum( INSTR_TIME_GET_DOUBLE(duration) * 1000000000.0 / iterations );
+
+	tupdesc = BlessTupleDesc(tupdesc);
+	PG_RETURN_DATUM( HeapTupleGetDatum( heap_form_tuple(tupdesc, values, nulls) ) );
+}
+
+static void
+bench_one(BenchOp op, FunctionCallInfo fcinfo, Variant sample, VariantInt vi, char *sample_cstring)
+{
+	VariantDataInt		vi_copy;
+
+	switch (op)
+	{
+		case BENCH_MAKE_VARIANT:
+			/* make_variant() scribbles on it's input */
+			vi_copy = *vi;
+			make_variant(&vi_copy, fcinfo, IOFunc_input);
+			break;
+		case BENCH_MAKE_VARIANT_INT:
+			make_variant_int(sample, fcinfo, IOFunc_input);
+			break;
+		case BENCH_OUT:
+			variant_out_arg(fcinfo, 0);
+			break;
+		case BENCH_IN:
+			variant_in_int(fcinfo, sample_cstring, sample->typmod);
+			break;
+		case BENCH_CMP:
+			variant_cmp_int(fcinfo);
+			break;
+		case BENCH_HASH:
+			variant_hash(fcinfo);
+			break;
+	}
+}
+
+/*
+ * variant_stats: Return runtime statistics, one row per counter
+ *
+ * If shared is true return the cluster-wide numbers instead of the numbers for
+ * this backend. That returns nothing if we're not in shared_preload_libraries.
+ */
+PG_FUNCTION_INFO_V1(variant_stats);
+Datum
+variant_stats(PG_FUNCTION_ARGS)
+{
+	FuncCallContext		*funcctx;
+	int64							*values;
+
+	Assert(fcinfo->flinfo->fn_strict); /* Must be strict */
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext		oldcontext;
+		TupleDesc				tupdesc;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			elog(ERROR, "return type must be a row type");
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		/* Take a snapshot so all the counters are consistent with each other */
+		values = palloc(sizeof(local_stats));
+		funcctx->max_calls = NUM_STATS;
+		if (!PG_GETARG_BOOL(0))
+			memcpy(values, local_stats, sizeof(local_stats));
+		else if (shared_stats != NULL)
+		{
+			/* Include what we've done so far in this transaction */
+			stats_flush();
+
+			SpinLockAcquire(&shared_stats->mutex);
+			memcpy(values, shared_stats->stats, sizeof(local_stats));
+			SpinLockRelease(&shared_stats->mutex);
+		}
+		else
+			funcctx->max_calls = 0;
+		funcctx->user_fctx = values;
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	values = (int64 *) funcctx->user_fctx;
+
+	if (funcctx->call_cntr < funcctx->max_calls)
+	{
+		Datum			result[2];
+		bool			nulls[2] = {false, false};
+
+		result[0] = CStringGetTextDatum(stat_names[funcctx->call_cntr]);
+		result[1] = Int64GetDatum(values[funcctx->call_cntr]);
+
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(heap_form_tuple(funcctx->tuple_desc, result, nulls)));
+	}
+
+	SRF_RETURN_DONE(funcctx);
+}
+
+/*
+ * variant_stats_reset: Zero runtime statistics for this backend or cluster
+ */
+PG_FUNCTION_INFO_V1(variant_stats_reset);
+Datum
+variant_stats_reset(PG_FUNCTION_ARGS)
+{
+	Assert(fcinfo->flinfo->fn_strict); /* Must be strict */
+
+	if (PG_GETARG_BOOL(0))
+	{
+		if (shared_stats == NULL)
+			ereport(ERROR,
+					( errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						errmsg( "cluster-wide variant statistics are not available" ),
+						errhint( "add variant to shared_preload_libraries" )
+					)
+				);
+		if (!superuser())
+			ereport(ERROR,
+					( errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+						errmsg( "must be superuser to reset cluster-wide variant statistics" )
+					)
+				);
+
+		SpinLockAcquire(&shared_stats->mutex);
+		MemSet(shared_stats->stats, 0, sizeof(shared_stats->stats));
+		SpinLockRelease(&shared_stats->mutex);
+
+		/* Don't add anything from before the reset */
+		memcpy(local_stats_flushed, local_stats, sizeof(local_stats));
+	}
+	else
+	{
+		/* Make sure the cluster numbers don't lose anything */
+		stats_flush();
+
+		MemSet(local_stats, 0, sizeof(local_stats));
+		MemSet(local_stats_flushed, 0, sizeof(local_stats_flushed));
+	}
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * variant_storage_info: Break down the space used by one variant
+ *
+ * header, overflow, padding and payload add up to raw (our size with a 4
+ * byte varlena header), except that a value stored with a short varlena
+ * header only has a 1 byte varlena header. stored is what's actually on disk
+ * (or in the TOAST table) and can be smaller than raw due to compression.
+ *
+ * Like variant_type_out this only fetches our header. The rest comes from the
+ * varlena and TOAST headers.
+ */
+PG_FUNCTION_INFO_V1(variant_storage_info);
+Datum
+variant_storage_info(PG_FUNCTION_ARGS)
+{
+	Datum			d = PG_GETARG_DATUM(0);
+	Pointer		ptr = DatumGetPointer(d);
+	TupleDesc	tupdesc = (TupleDesc) fcinfo->flinfo->fn_extra;
+	Datum			values[9];
+	bool			nulls[9];
+	uint			flags;
+	Oid				typid;
+	Size			raw;
+	Size			stored;
+	int				hdrsz;
+	int				header;
+	int				overflow;
+	int				padding = 0;
+	bool			external;
+
+	Assert(fcinfo->flinfo->fn_strict); /* Must be strict */
+
+	/* This gets called for every row in a table, so only bless once */
+	if (tupdesc == NULL)
+	{
+		MemoryContext	oldcontext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			elog(ERROR, "return type must be a row type");
+		tupdesc = BlessTupleDesc(CreateTupleDescCopy(tupdesc));
+		fcinfo->flinfo->fn_extra = (void *) tupdesc;
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	typid = get_oid_datum(d, &flags);
+	raw = toast_raw_datum_size(d);
+	stored = toast_datum_size(d);
+	external = VARATT_IS_EXTERNAL(ptr);
+
+	overflow = (flags & VAR_OVERFLOW) ? 1 : 0;
+	/* Compact variants only have the registered typmod; see variant_compact() */
+	hdrsz = (flags & VAR_VERSION) ? VARHDRSZ + sizeof(Oid) : VHDRSZ;
+	header = VARATT_IS_SHORT(ptr) ? hdrsz - VARHDRSZ + VARHDRSZ_SHORT : hdrsz;
+
+	/*
+	 * Only pass-by-value types are aligned, and only in normal variants. Don't
+	 * choke if the type has been dropped; we just can't tell what the padding
+	 * was.
+	 */
+	MemSet(nulls, false, sizeof(nulls));
+	if (!(flags & (VAR_ISNULL | VAR_VERSION)))
+	{
+		if (SearchSysCacheExists1(TYPEOID, ObjectIdGetDatum(typid)))
+		{
+			int16		typlen;
+			bool		typbyval;
+			char		typalign;
+
+			get_typlenbyvalalign(typid, &typlen, &typbyval, &typalign);
+			if (typbyval)
+				padding = att_align_nominal(VHDRSZ, typalign) - VHDRSZ;
+		}
+		else
+			nulls[3] = true;
+	}
+
+	values[0] = ObjectIdGetDatum(typid);
+	values[1] = Int32GetDatum(header);
+	values[2] = Int32GetDatum(overflow);
+	values[3] = Int32GetDatum(padding);
+	values[4] = Int32GetDatum(raw - hdrsz - overflow - padding);
+	values[5] = Int32GetDatum(raw);
+	values[6] = Int32GetDatum(stored);
+	values[7] = BoolGetDatum(external);
+	/* For external values stored is the size in the TOAST table, sans header */
+	values[8] = BoolGetDatum(VARATT_IS_COMPRESSED(ptr) ||
+							 (external && stored < raw - VARHDRSZ));
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/*
+ ********************
+ * SUPPORT FUNCTIONS
+ ********************
+ */
+
+static Variant
+variant_in_int(FunctionCallInfo fcinfo, char *input, int variant_typmod)
+{
+	VariantCache	*cache;
+	bool					isnull;
+	Oid						intTypeOid = InvalidOid;
+	int32					typmod = 0;
+	text					*orgType;
+	text					*orgData;
+	VariantDataInt	vid;
+	VariantInt		vi = &vid;
+	MemoryContext	oldcxt;
+	Variant				out;
+
+	MemSet(vi, 0, sizeof(*vi));
+
+	/*
+	 * Everything up to make_variant() is garbage once we're done, and variant
+	 * input is used for every row of a COPY, so do it all in scratch space.
+	 */
+	oldcxt = MemoryContextSwitchTo(get_scratch(fcinfo));
+
+	/* Eventually getting rid of this crap, so segregate it */
+		intTypeOid = getIntOid();
+
+		FmgrInfo	 		proc;
+		Datum						composite;
+		HeapTupleHeader	composite_tuple;
+		Oid							typioparam;
+		Oid							typIoFunc;
+
+		/* Cast input data to our internal composite type */
+		getTypeInputInfo(intTypeOid, &typIoFunc, &typioparam);
+		/* record_in caches stuff in fn_mcxt, so that can't be fn_mcxt */
+		fmgr_info(typIoFunc, &proc);
+		composite=InputFunctionCall(&proc, input, typioparam, typmod);
+
+		/* Extract data from internal composite type */
+		composite_tuple=DatumGetHeapTupleHeader(composite);
+		orgType = (text *) GetAttributeByNum( composite_tuple, 1, &isnull );
+		if (isnull)
+			elog(ERROR, "original_type of variant must not be NULL");
+		orgData = (text *) GetAttributeByNum( composite_tuple, 2, &vi->isnull );
+	/* End crap */
+
+#ifdef LONG_PARSETYPE
+	parseTypeString(text_to_cstring(orgType), &vi->typid, &vi->typmod, false);
+#else
+	parseTypeString(text_to_cstring(orgType), &vi->typid, &vi->typmod);
+#endif
+
+	/*
+	 * Verify we've been handed a valid typmod
+	 */
+	variant_check_type(variant_typmod, vi->typid);
+
+	cache = get_cache(fcinfo, vi, IOFunc_input);
+
+	if (!vi->isnull)
+		/* Actually need to be using stringTypeDatum(Type tp, char *string, int32 atttypmod) */
+		vi->data = InputFunctionCall(&cache->proc, text_to_cstring(orgData), cache->typioparam, vi->typmod);
+
+	MemoryContextSwitchTo(oldcxt);
+	out = variant_pack(make_variant(vi, fcinfo, IOFunc_input), variant_typmod);
+
+	return out;
+}
+
+/*
+ * variant_out_arg: Text output for argument argno
+ *
+ * The variant is decoded in the call site's scratch context, so the only thing
+ * left behind is the result.
+ */
+static char *
+variant_out_arg(FunctionCallInfo fcinfo, int argno)
+{
+	MemoryContext	oldcxt = MemoryContextSwitchTo(get_scratch(fcinfo));
+	VariantInt		vi = variant_get_int(fcinfo, argno, IOFunc_output, NULL);
+
+	MemoryContextSwitchTo(oldcxt);
+	return variant_out_int(fcinfo, vi);
+}
+
+static char *
+variant_out_int(FunctionCallInfo fcinfo, VariantInt vi)
+{
+	VariantCache	*cache;
+	char					*tmp;
+	char					*org_cstring;
+	char					*out;
+	char					*p;
+	size_t				len;
+	size_t				pos;
+
+	Assert(fcinfo->flinfo->fn_strict); /* Must be strict */
+
+	cache = GetCache(fcinfo);
+	Assert(cache->out_prefix);
+
+	if(vi->isnull)
+	{
+		out = palloc(cache->out_prefix_len + 2);
+		memcpy(out, cache->out_prefix, cache->out_prefix_len);
+		out[cache->out_prefix_len] = ')';
+		out[cache->out_prefix_len + 1] = '\0';
+		return out;
+	}
+
+	/* Output functions can leave garbage behind; keep it in scratch if we have it */
+	if (cache->scratch != NULL)
+	{
+		MemoryContext	oldcxt = MemoryContextSwitchTo(cache->scratch);
+
+		org_cstring = OutputFunctionCall(&cache->proc, vi->data);
+		MemoryContextSwitchTo(oldcxt);
+	}
+	else
+		org_cstring = OutputFunctionCall(&cache->proc, vi->data);
+	len = strlen(org_cstring);
+
+	/*
+	 * Find the first character that means we need double quotes. Quoting rules
+	 * are stolen from record_out. Empty strings are always quoted.
+	 */
+	pos = variant_quote_scan(org_cstring, len);
+
+	if (len > 0 && pos == len)
+	{
+		out = palloc(cache->out_prefix_len + len + 2);
+		p = out;
+		memcpy(p, cache->out_prefix, cache->out_prefix_len);
+		p += cache->out_prefix_len;
+		memcpy(p, org_cstring, len);
+		p += len;
+	}
+	else
+	{
+		/*
+		 * Everything before pos can be copied as-is. After that, worst case is
+		 * every character needs to be doubled.
+		 */
+		out = palloc(cache->out_prefix_len + len + (len - pos) + 4);
+		p = out;
+		memcpy(p, cache->out_prefix, cache->out_prefix_len);
+		p += cache->out_prefix_len;
+		*p++ = '"';
+		memcpy(p, org_cstring, pos);
+		p += pos;
+		for (tmp = org_cstring + pos; *tmp; tmp++)
+		{
+			char		ch = *tmp;
+
+			if (ch == '"' || ch == '\\')
+				*p++ = ch;
+			*p++ = ch;
+		}
+		*p++ = '"';
+	}
+	*p++ = ')';
+	*p = '\0';
+
+	pfree(org_cstring);
+
+	return out;
+}
+
+/*
+ * variant_quote_scan: Return position of first character in str that forces
+ * quoting, or len if there isn't one.
+ *
+ * On 16+ we skip over chunks that can't contain such a character using
+ * port/simd.h. A chunk with any high-bit byte goes through the exact check
+ * since isspace() is locale dependent for those.
+ */
+static size_t
+variant_quote_scan(const char *str, size_t len)
+{
+	static bool		quote_chars[256];
+	static bool		quote_chars_ready = false;
+	size_t				i = 0;
+
+	if (!quote_chars_ready)
+	{
+		int		c;
+
+		for (c = 0; c < 256; c++)
+			quote_chars[c] = (c == '"' || c == '\\' ||
+				c == '(' || c == ')' || c == ',' ||
+				isspace(c));
+		quote_chars_ready = true;
+	}
+
+#if PG_VERSION_NUM >= 160000
+	for (; i + sizeof(Vector8) <= len; i += sizeof(Vector8))
+	{
+		Vector8		chunk;
+
+		vector8_load(&chunk, (const uint8 *) str + i);
+		if (vector8_has_le(chunk, '\r') ||		/* \t through \r */
+			vector8_has(chunk, ' ') ||
+			vector8_has(chunk, '"') ||
+			vector8_has(chunk, '\\') ||
+			vector8_has(chunk, '(') ||
+			vector8_has(chunk, ')') ||
+			vector8_has(chunk, ',') ||
+			vector8_is_highbit_set(chunk))
+			break;
+	}
+#endif
+
+	for (; i < len; i++)
+		if (quote_chars[(unsigned char) str[i]])
+			return i;
+
+	return len;
+}
+
+/*
+ * variant_get_variant_name: Return the name of a named variant
+ *
+ * The registration record comes from our cache; see registry_lookup().
+ */
+char *
+variant_get_variant_name(int typmod, Oid org_typid, bool ignore_storage)
+{
+	RegisteredVariant	*rv = registry_lookup(typmod);
+	int								i;
+
+	/*
+	 * There's a race condition here; someone could be attempting to remove an
+	 * allowed type from this registered variant or even remove it entirely. We
+	 * could avoid that by taking a share/keyshare lock here and taking the
+	 * appropriate blocking lock when modifying the registration record. Doing
+	 * that would probably be quite bad though; not only are type IO and typmod
+	 * IO routines assumed to be non-volatile, taking such a lock would end up
+	 * generating a lot of lock updates to the registration rows.
+	 *
+	 * Since the whole purpose of registration is to handle the issue of someone
+	 * attempting to drop a type that has made it into a variant in a table
+	 * column, which we can't completely handle anyway, I don't think it's worth
+	 * it to lock the rows.
+	 */
+	if( !rv->enabled )
+		ereport( ERROR,
+				( errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg( "variant.variant(%s) is disabled", rv->variant_name )
+				)
+			);
+
+	/*
+	 * If storage is allowed, then throw an error if we don't know what our
+	 * original type is, or if that type is not listed as allowed.
+	 */
+	if( !ignore_storage && rv->storage_allowed )
+	{
+		if( org_typid == InvalidOid)
+			ereport( ERROR,
+					( errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg( "Unable to determine original type" )
+					)
+				);
+
+		for (i = 0; i < rv->nallowed; i++)
+			if (rv->allowed_types[i] == org_typid)
+				break;
+
+		/* Dynamic variants approve new types instead of complaining about them */
+		if (i == rv->nallowed && !(rv->dynamic && approval_record(typmod, org_typid)))
+			ereport( ERROR,
+					( errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg( "type %s is not allowed in variant.variant(%s)", format_type_be(org_typid), rv->variant_name ),
+						errhint( "you can permanently allow a type to be used by calling variant.allow_type()" )
+					)
+				);
+	}
+
+	return pstrdup(rv->variant_name);
+}
+
+/*
+ * variant_check_type: Make sure typid may be stored in variant typmod
+ *
+ * Same as variant_get_variant_name(typmod, typid, false), except in bulk load
+ * mode. See comments above BulkLoadEntry.
+ */
+static void
+variant_check_type(int typmod, Oid typid)
+{
+	VariantTypeKey	key;
+	BulkLoadEntry		*entry;
+
+	if (!bulk_load)
+	{
+		pfree(variant_get_variant_name(typmod, typid, false));
+		return;
+	}
+
+	if (bulk_pairs == NULL)
+	{
+		HASHCTL		ctl;
+
+		if (bulk_cxt == NULL)
+			bulk_cxt = AllocSetContextCreate(TopMemoryContext, "variant bulk load",
+					ALLOCSET_SMALL_MINSIZE, ALLOCSET_SMALL_INITSIZE, ALLOCSET_SMALL_MAXSIZE);
+
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(VariantTypeKey);
+		ctl.entrysize = sizeof(BulkLoadEntry);
+		ctl.hash = tag_hash;
+		ctl.hcxt = bulk_cxt;
+		bulk_pairs = hash_create("variant bulk load", 16, &ctl,
+				HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+	}
+
+	/* Zero padding so hashing is stable */
+	MemSet(&key, 0, sizeof(key));
+	key.typmod = typmod;
+	key.typid = typid;
+
+	entry = hash_search(bulk_pairs, &key, HASH_FIND, NULL);
+	if (entry == NULL)
+	{
+		/* Throws an error if this pair isn't allowed */
+		char	*variant_name = variant_get_variant_name(typmod, typid, false);
+
+		entry = hash_search(bulk_pairs, &key, HASH_ENTER, NULL);
+		entry->variant_name = MemoryContextStrdup(bulk_cxt, variant_name);
+		entry->rows = 0;
+		pfree(variant_name);
+	}
+	entry->rows++;
+}
+
+/*
+ * bulk_load_report: Report and forget bulk load counts
+ */
+static void
+bulk_load_report(void)
+{
+	HASH_SEQ_STATUS	status;
+	BulkLoadEntry		*entry;
+
+	if (bulk_pairs == NULL)
+		return;
+
+	hash_seq_init(&status, bulk_pairs);
+	while ((entry = (BulkLoadEntry *) hash_seq_search(&status)) != NULL)
+		ereport(NOTICE,
+				( errmsg( "variant bulk load: " INT64_FORMAT " values of type %s in variant.variant(%s)",
+									entry->rows,
+									format_type_be(entry->key.typid),
+									entry->variant_name )
+				)
+			);
+
+	bulk_load_reset();
+}
+
+static void
+bulk_load_reset(void)
+{
+	bulk_pairs = NULL;
+	if (bulk_cxt != NULL)
+		MemoryContextReset(bulk_cxt);
+}
+
+/*
+ * approval_record: Remember that a dynamic variant approved typid
+ *
+ * Writing to _variant._registered for every value would be horribly slow, and
+ * would make the cast path write to a catalog. Instead we just remember the
+ * approval here; approval_flush() adds the types to allowed_types once per
+ * transaction, just before commit. Always returns true.
+ *
+ * Note that an approval made in a subtransaction that rolls back is still
+ * written out. That's harmless; the type is just allowed a bit early.
+ */
+static bool
+approval_record(int typmod, Oid typid)
+{
+	VariantTypeKey	key;
+
+	if (approvals == NULL)
+	{
+		HASHCTL		ctl;
+
+		if (approval_cxt == NULL)
+			approval_cxt = AllocSetContextCreate(TopMemoryContext, "variant approvals",
+					ALLOCSET_SMALL_MINSIZE, ALLOCSET_SMALL_INITSIZE, ALLOCSET_SMALL_MAXSIZE);
+
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(VariantTypeKey);
+		ctl.entrysize = sizeof(VariantTypeKey);
+		ctl.hash = tag_hash;
+		ctl.hcxt = approval_cxt;
+		approvals = hash_create("variant approvals", 16, &ctl,
+				HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+	}
+
+	/* Zero padding so hashing is stable */
+	MemSet(&key, 0, sizeof(key));
+	key.typmod = typmod;
+	key.typid = typid;
+	hash_search(approvals, &key, HASH_ENTER, NULL);
+
+	return true;
+}
+
+/*
+ * approval_flush: Write this transaction's approvals to _variant._registered
+ *
+ * Called at pre-commit or pre-prepare. variant._approve_types() only adds
+ * types, so _variant._tg_check_type_usage() has nothing to check. It also
+ * re-checks that the variant is still dynamic, in case that changed since we
+ * cached the registration record, and throws an error if not, which aborts
+ * the transaction.
+ */
+static void
+approval_flush(void)
+{
+	HASH_SEQ_STATUS	status;
+	VariantTypeKey	*entry;
+	HTAB						*pending = approvals;
+	bool						do_pop;
+	Oid							types[2] = {INT4OID, REGTYPEARRAYOID};
+	char						*cmd = "SELECT variant._approve_types($1, $2)";
+	int							ret;
+	Oid							save_userid;
+	int							save_sec_context;
+
+	if (pending == NULL)
+		return;
+
+	/* Nothing we do here can have been stored */
+	if (XactReadOnly)
+	{
+		approval_reset();
+		return;
+	}
+
+	/* Forget the set first so an error here doesn't leave it behind */
+	approvals = NULL;
+
+	/* Only the extension owner may run variant._approve_types() */
+	GetUserIdAndSecContext(&save_userid, &save_sec_context);
+	SetUserIdAndSecContext(variant_owner(), save_sec_context | SECURITY_LOCAL_USERID_CHANGE);
+
+	do_pop = _SPI_conn();
+	hash_seq_init(&status, pending);
+	while ((entry = (VariantTypeKey *) hash_seq_search(&status)) != NULL)
+	{
+		Datum		typid = ObjectIdGetDatum(entry->typid);
+		Datum		values[2];
+
+		values[0] = Int32GetDatum(entry->typmod);
+		values[1] = PointerGetDatum(construct_array(&typid, 1, REGTYPEOID, sizeof(Oid), true, 'i'));
+
+		/* command, nargs, Oid *argument_types, *values, *nulls, read_only, count */
+		if( (ret = SPI_execute_with_args( cmd, 2, types, values, NULL, false, 0 )) != SPI_OK_SELECT )
+			elog( ERROR, "SPI_execute_with_args(%s) returned %s", cmd, SPI_result_code_string(ret));
+	}
+	_SPI_disc(do_pop);
+	SetUserIdAndSecContext(save_userid, save_sec_context);
+
+	approval_reset();
+}
+
+static void
+approval_reset(void)
+{
+	approvals = NULL;
+	if (approval_cxt != NULL)
+		MemoryContextReset(approval_cxt);
+}
+
+/*
+ * variant_pack: Put a new variant into the form variant_typmod stores it in
+ *
+ * Large payloads aren't interned here, since most new variants are never
+ * stored; see variant_intern_trigger().
+ */
+static Variant
+variant_pack(Variant v, int variant_typmod)
+{
+	RegisteredVariant	*rv;
+
+	if (variant_typmod < 0)
+		return v;
+
+	rv = registry_lookup(variant_typmod);
+	if (OidIsValid(rv->fixed_type))
+		return variant_compact(v, variant_typmod, rv);
+
+	return v;
+}
+
+/*
+ * variant_compact: Store a value of a fixed type variant's type without our header
+ *
+ * The column typmod isn't available to output functions, so a datum has to
+ * say what it is by itself. For a fixed type variant the registered typmod
+ * says that, so a compact variant is a varlena header, then the variant
+ * typmod with VAR_VERSION set (and VAR_ISNULL if it's a NULL), then the
+ * payload. Pass-by-value payloads aren't aligned. That saves the Oid, the
+ * original typmod and any alignment padding.
+ *
+ * Values with a type modifier keep the normal format, since there's no room
+ * for the modifier. compact_expand() turns a compact variant back into the
+ * normal format; variant_detoast_datum() does that, so nothing else needs to
+ * know about it. The exception is make_variant_int(), which decodes compact
+ * variants directly so the hot paths don't build a normal variant first.
+ */
+static Variant
+variant_compact(Variant v, int variant_typmod, RegisteredVariant *rv)
+{
+	uint					flags;
+	Oid						typid = get_oid(v, &flags);
+	Pointer				payload;
+	long					len;
+	struct varlena	*out;
+	Oid						header;
+
+#ifdef VARIANT_TEST_OID
+	typid -= OID_MASK;
+#endif
+
+	if (typid != rv->fixed_type || v->typmod != -1)
+		return v;
+
+	if (flags & VAR_ISNULL)
+	{
+		payload = NULL;
+		len = 0;
+	}
+	else if (rv->fixed_typbyval)
+	{
+		payload = VDATAPTR_ALIGN(v, rv->fixed_typalign);
+		len = rv->fixed_typlen;
+	}
+	else
+	{
+		payload = VDATAPTR(v);
+		len = VARSIZE(v) - VHDRSZ - (flags & VAR_OVERFLOW ? 1 : 0);
+	}
+
+	header = VAR_VERSION | (flags & VAR_ISNULL) | (Oid) variant_typmod;
+	out = palloc(VARHDRSZ + sizeof(header) + len);
+	SET_VARSIZE(out, VARHDRSZ + sizeof(header) + len);
+	memcpy(VARDATA(out), &header, sizeof(header));
+	if (len > 0)
+		memcpy(VARDATA(out) + sizeof(header), payload, len);
+
+	pfree(v);
+	return (Variant) out;
+}
+
+/*
+ * compact_decode: Fill in vi from a compact variant
+ *
+ * Pass-by-value payloads are fetched directly. Anything else is copied
+ * once, since the payload is neither aligned nor has a varlena header. The
+ * fixed type's storage information is returned in typlen, typbyval and
+ * typalign.
+ */
+static void
+compact_decode(struct varlena *v, VariantInt vi, int16 *typlen, bool *typbyval, char *typalign)
+{
+	Oid							header;
+	int							variant_typmod;
+	RegisteredVariant	*rv;
+	const char			*payload = VARDATA_ANY(v) + sizeof(header);
+	long						len = VARSIZE_ANY_EXHDR(v) - sizeof(header);
+
+	/* Short varlenas aren't aligned */
+	memcpy(&header, VARDATA_ANY(v), sizeof(header));
+	variant_typmod = header & OID_MASK;
+
+	rv = registry_lookup(variant_typmod);
+	if (!OidIsValid(rv->fixed_type))
+		ereport(ERROR,
+				( errcode(ERRCODE_DATA_CORRUPTED),
+					errmsg( "compact variant for variant.variant(%s), which is not a fixed type variant", rv->variant_name )
+				)
+			);
+
+	/* rv is only good until the next registry lookup */
+	*typlen = rv->fixed_typlen;
+	*typbyval = rv->fixed_typbyval;
+	*typalign = rv->fixed_typalign;
+
+	vi->typid = rv->fixed_type;
+	vi->typmod = -1;
+	vi->isnull = (header & VAR_ISNULL) != 0;
+	vi->data = (Datum) 0;
+
+	if (vi->isnull)
+		return;
+
+	if (*typbyval)
+	{
+		Datum		buf;		/* Aligned enough for anything pass-by-value */
+
+		Assert(len == *typlen);
+		memcpy(&buf, payload, *typlen);
+		vi->data = fetch_att(&buf, true, *typlen);
+	}
+	else if (*typlen == -1)
+	{
+		struct varlena	*data = palloc(len + VARHDRSZ);
+
+		STAT_ADD(STAT_BYTES_COPIED, len + VARHDRSZ);
+		SET_VARSIZE(data, len + VARHDRSZ);
+		memcpy(VARDATA(data), payload, len);
+		vi->data = PointerGetDatum(data);
+	}
+	else if (*typlen == -2)
+	{
+		STAT_ADD(STAT_BYTES_COPIED, len + 1);
+		vi->data = CStringGetDatum(pnstrdup(payload, len));
+	}
+	else
+	{
+		/* palloc'd memory is aligned for anything */
+		Pointer		data = palloc(len);
+
+		Assert(len == *typlen);
+		STAT_ADD(STAT_BYTES_COPIED, len);
+		memcpy(data, payload, len);
+		vi->data = PointerGetDatum(data);
+	}
+}
+
+/*
+ * compact_expand: Turn a compact variant back into a normal one
+ *
+ * Only for callers that need the normal format; make_variant_int() decodes
+ * compact variants directly.
+ */
+static Variant
+compact_expand(struct varlena *v)
+{
+	VariantDataInt	vid;
+	int16						typlen;
+	bool						typbyval;
+	char						typalign;
+
+	compact_decode(v, &vid, &typlen, &typbyval, &typalign);
+	return make_variant_typ(&vid, typlen, typbyval, typalign);
+}
+
+/*
+ * variant_intern: Replace a large payload with a reference to _variant._interned
+ *
+ * Only done if the registered variant has an intern_threshold and the
+ * payload is at least that big. The payload is written to _variant._interned
+ * the first time this (sub)transaction sees it; after that making another
+ * reference to it only costs a SHA-256. Returns v itself if it isn't
+ * interned.
+ *
+ * Only variant_intern_trigger() calls this, so the _variant._interned row is
+ * written by the same (sub)transaction as the row that references it.
+ */
+static Variant
+variant_intern(Variant v, int variant_typmod)
+{
+#if PG_VERSION_NUM >= 110000
+	RegisteredVariant	*rv;
+	uint							flags;
+	int								overflow;
+	long							len;
+	bytea							*payload;
+	bytea							*digest;
+	InternEntry				*entry;
+	Variant						out;
+
+	if (variant_typmod < 0)
+		return v;
+
+	(void) get_oid(v, &flags);
+	if (flags & VAR_ISNULL)
+		return v;
+
+	rv = registry_lookup(variant_typmod);
+	overflow = (flags & VAR_OVERFLOW) ? 1 : 0;
+	len = VARSIZE(v) - VHDRSZ - overflow;
+	if (rv->intern_threshold <= 0 || len < rv->intern_threshold)
+		return v;
+
+	payload = palloc(len + VARHDRSZ);
+	SET_VARSIZE(payload, len + VARHDRSZ);
+	memcpy(VARDATA(payload), VDATAPTR(v), len);
+	digest = DatumGetByteaPP(DirectFunctionCall1(sha256_bytea, PointerGetDatum(payload)));
+	Assert(VARSIZE_ANY_EXHDR(digest) == VAR_INTERNED_LEN);
+
+	entry = intern_cache_entry((uint8 *) VARDATA_ANY(digest), payload, true);
+	if (entry == NULL || !entry->stored)
+	{
+		/* If this fails the transaction is toast, and so is the cache's idea of what's stored */
+		if (entry != NULL)
+			entry->stored = true;
+		intern_store(payload);
+	}
+
+	/* Same header and overflow byte, with the digest as our payload */
+	out = palloc0(VHDRSZ + VAR_INTERNED_LEN + overflow);
+	SET_VARSIZE(out, VHDRSZ + VAR_INTERNED_LEN + overflow);
+	out->pOid = v->pOid | VAR_ISNULL;
+	out->typmod = v->typmod;
+	memcpy(VDATAPTR(out), VARDATA_ANY(digest), VAR_INTERNED_LEN);
+	if (overflow)
+		*((char *) out + VARSIZE(out) - 1) = *((char *) v + VARSIZE(v) - 1);
+
+	pfree(payload);
+	return out;
+#else
+	return v;
+#endif
+}
+
+/*
+ * intern_store: Write payload to _variant._interned
+ */
+static void
+intern_store(bytea *payload)
+{
+	bool				do_pop;
+	Oid					types[1] = {BYTEAOID};
+	Datum				values[1];
+	char				*cmd = "SELECT variant._intern($1)";
+	int					ret;
+	Oid					save_userid;
+	int					save_sec_context;
+
+	/* Only the extension owner may run variant._intern(), which computes the digest itself */
+	GetUserIdAndSecContext(&save_userid, &save_sec_context);
+	SetUserIdAndSecContext(variant_owner(), save_sec_context | SECURITY_LOCAL_USERID_CHANGE);
+
+	values[0] = PointerGetDatum(payload);
+	do_pop = _SPI_conn();
+	/* command, nargs, Oid *argument_types, *values, *nulls, read_only, count */
+	if( (ret = SPI_execute_with_args( cmd, 1, types, values, NULL, false, 0 )) != SPI_OK_SELECT )
+		elog( ERROR, "SPI_execute_with_args(%s) returned %s", cmd, SPI_result_code_string(ret));
+	_SPI_disc(do_pop);
+	SetUserIdAndSecContext(save_userid, save_sec_context);
+}
+
+/*
+ * intern_ensure_stored: Make sure the payload of a reference is in _variant._interned
+ *
+ * A reference can outlive the row it points at, for example if it was read
+ * from a row written by a subtransaction that rolled back. If we still have
+ * the payload we write it again. Otherwise intern_resolve() reads it from
+ * _variant._interned, and complains if it's gone.
+ */
+static void
+intern_ensure_stored(struct varlena *v)
+{
+	const uint8		*digest = (uint8 *) VARDATA_ANY(v) + VHDRSZ - VARHDRSZ;
+	InternEntry		*entry = intern_cache_entry(digest, NULL, false);
+
+	if (entry == NULL)
+	{
+		pfree(intern_resolve(v));
+		return;
+	}
+	if (entry->stored)
+		return;
+
+	entry->stored = true;
+	intern_store(entry->payload);
+}
+
+/*
+ * variant_is_interned: Does a (detoasted, possibly short) variant hold a reference?
+ */
+static bool
+variant_is_interned(struct varlena *v)
+{
+	Oid		pOid;
+	Size	len = VARSIZE_ANY_EXHDR(v);
+
+	if (len < VHDRSZ - VARHDRSZ + VAR_INTERNED_LEN)
+		return false;
+
+	/* Short varlenas aren't aligned */
+	memcpy(&pOid, VARDATA_ANY(v), sizeof(pOid));
+	return (pOid & (VAR_ISNULL | VAR_VERSION)) == VAR_ISNULL;
+}
+
+/*
+ * variant_is_compact: Is a (detoasted, possibly short) variant compact?
+ *
+ * See variant_compact().
+ */
+static bool
+variant_is_compact(struct varlena *v)
+{
+	Oid		pOid;
+
+	memcpy(&pOid, VARDATA_ANY(v), sizeof(pOid));
+	return (pOid & VAR_VERSION) != 0;
+}
+
+/*
+ * intern_resolve: Return a copy of an interned variant with its real payload
+ */
+static Variant
+intern_resolve(struct varlena *v)
+{
+	VariantData		hdr;
+	const uint8		*digest = (uint8 *) VARDATA_ANY(v) + VHDRSZ - VARHDRSZ;
+	int						overflow;
+	InternEntry		*entry;
+	bytea					*payload;
+	long					len;
+	Variant				out;
+
+	memcpy(&hdr.pOid, VARDATA_ANY(v), VHDRSZ - VARHDRSZ);
+	overflow = (hdr.pOid & VAR_OVERFLOW) ? 1 : 0;
+
+	entry = intern_cache_entry(digest, NULL, false);
+	if (entry != NULL)
+		payload = entry->payload;
+	else
+	{
+		bool				do_pop;
+		Oid					types[1] = {BYTEAOID};
+		Datum				values[1];
+		bytea				*d = palloc(VAR_INTERNED_LEN + VARHDRSZ);
+		char				*cmd = "SELECT variant._interned_payload($1)";
+		bool				isnull;
+		int					ret;
+		MemoryContext	oldcxt = CurrentMemoryContext;
+		Oid					save_userid;
+		int					save_sec_context;
+
+		SET_VARSIZE(d, VAR_INTERNED_LEN + VARHDRSZ);
+		memcpy(VARDATA(d), digest, VAR_INTERNED_LEN);
+		values[0] = PointerGetDatum(d);
+
+		/* Only the extension owner may run variant._interned_payload() */
+		GetUserIdAndSecContext(&save_userid, &save_sec_context);
+		SetUserIdAndSecContext(variant_owner(), save_sec_context | SECURITY_LOCAL_USERID_CHANGE);
+
+		do_pop = _SPI_conn();
+		/* command, nargs, Oid *argument_types, *values, *nulls, read_only, count */
+		if( (ret = SPI_execute_with_args( cmd, 1, types, values, " ", true, 1 )) != SPI_OK_SELECT )
+			elog( ERROR, "SPI_execute_with_args(%s) returned %s", cmd, SPI_result_code_string(ret));
+		Assert( SPI_tuptable && SPI_processed == 1 );
+
+		payload = (bytea *) DatumGetPointer( SPI_getbinval( SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isnull ) );
+		if (isnull)
+			ereport(ERROR,
+					( errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg( "interned variant payload is missing from _variant._interned" )
+					)
+				);
+
+		/* SPI memory goes away in _SPI_disc() */
+		MemoryContextSwitchTo(oldcxt);
+		payload = (bytea *) PG_DETOAST_DATUM_COPY(PointerGetDatum(payload));
+		_SPI_disc(do_pop);
+		SetUserIdAndSecContext(save_userid, save_sec_context);
+
+		entry = intern_cache_entry(digest, payload, true);
+		if (entry != NULL)
+			entry->stored = true;
+	}
+
+	len = VARSIZE_ANY_EXHDR(payload);
+	out = palloc(VHDRSZ + len + overflow);
+	SET_VARSIZE(out, VHDRSZ + len + overflow);
+	out->pOid = hdr.pOid & ~VAR_ISNULL;
+	out->typmod = hdr.typmod;
+	memcpy(VDATAPTR(out), VARDATA_ANY(payload), len);
+	if (overflow)
+		*((char *) out + VARSIZE(out) - 1) = *((char *) v + VARSIZE_ANY(v) - 1);
+
+	return out;
+}
+
+/*
+ * intern_cache_entry: Find or add the cache entry for digest
+ *
+ * If create is true and there's no entry one is added with a copy of
+ * payload. Returns NULL if there's no entry, or if there isn't room for
+ * payload within variant.intern_cache_size. The result is only good until
+ * the next call.
+ */
+static InternEntry *
+intern_cache_entry(const uint8 *digest, bytea *payload, bool create)
+{
+	InternEntry		*entry;
+	Size					size;
+	bool					found;
+
+	if (intern_cache != NULL)
+	{
+		entry = hash_search(intern_cache, digest, HASH_FIND, NULL);
+		if (entry != NULL || !create)
+			return entry;
+	}
+	else if (!create)
+		return NULL;
+
+	size = VARSIZE_ANY(payload) + sizeof(InternEntry);
+	if (size > (Size) intern_cache_size * 1024)
+		return NULL;
+
+	/* Rather than keep track of what's least recently used, just start over */
+	if (intern_cache == NULL || intern_cache_bytes + size > (Size) intern_cache_size * 1024)
+	{
+		HASHCTL		ctl;
+
+		if (intern_cxt == NULL)
+			intern_cxt = AllocSetContextCreate(TopMemoryContext, "variant intern cache",
+					ALLOCSET_DEFAULT_MINSIZE, ALLOCSET_DEFAULT_INITSIZE, ALLOCSET_DEFAULT_MAXSIZE);
+		else
+			MemoryContextReset(intern_cxt);
+
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = VAR_INTERNED_LEN;
+		ctl.entrysize = sizeof(InternEntry);
+		ctl.hash = tag_hash;
+		ctl.hcxt = intern_cxt;
+		intern_cache = hash_create("variant intern cache", 64, &ctl,
+				HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+		intern_cache_bytes = 0;
+	}
+
+	entry = hash_search(intern_cache, digest, HASH_ENTER, &found);
+	Assert(!found);
+	entry->payload = MemoryContextAlloc(intern_cxt, VARSIZE_ANY(payload));
+	memcpy(entry->payload, payload, VARSIZE_ANY(payload));
+	entry->stored = false;
+	intern_cache_bytes += size;
+
+	return entry;
+}
+
+/*
+ * intern_forget_stored: Called on (sub)transaction abort
+ *
+ * Anything we wrote to _variant._interned in the aborted transaction is gone,
+ * so we can't trust any of our stored flags.
+ */
+static void
+intern_forget_stored(void)
+{
+	HASH_SEQ_STATUS	status;
+	InternEntry			*entry;
+
+	if (intern_cache == NULL)
+		return;
+
+	hash_seq_init(&status, intern_cache);
+	while ((entry = (InternEntry *) hash_seq_search(&status)) != NULL)
+		entry->stored = false;
+}
+
+/*
+ * registry_relid_get: Return the Oid of _variant._registered
+ *
+ * Returns InvalidOid if the extension isn't installed in this database.
+ */
+static Oid
+registry_relid_get(void)
+{
+	if (!OidIsValid(registry_relid))
+	{
+		Oid		nsp = get_namespace_oid("_variant", true);
+
+		if (OidIsValid(nsp))
+			registry_relid = get_relname_relid("_registered", nsp);
+	}
+
+	return registry_relid;
+}
+
+/*
+ * registry_inval_callback: Relcache invalidation callback
+ *
+ * Also forgets our own Oids, since _variant._registered going away means the
+ * extension has been dropped.
+ */
+static void
+registry_inval_callback(Datum arg, Oid relid)
+{
+	if (relid == InvalidOid || relid == registry_relid)
+	{
+		registry_valid = false;
+		registry_relid = InvalidOid;
+		int_type_oid = InvalidOid;
+	}
+}
+
+/*
+ * registry_load: Load registration records into our cache
+ *
+ * Loads every registered variant if all is true, otherwise just typmod.
+ */
+static void
+registry_load(int typmod, bool all)
+{
+	bool						do_pop;
+	Oid							types[1] = {INT4OID};
+	Datum						values[1];
+	char						*cmd;
+	int							ret;
+	uint64					row;
+	instr_time			start;
+
+	STAT_INCR(STAT_SPI_GET_VARIANT_NAME);
+	SLOW_PATH_START(start);
+	do_pop = _SPI_conn();
+	values[0] = Int32GetDatum(typmod);
+
+	cmd = all
+		? "SELECT variant_typmod, variant_name, variant_enabled, storage_allowed, allowed_types, dynamic, intern_threshold, fixed_type FROM variant._registered"
+		: "SELECT variant_typmod, variant_name, variant_enabled, storage_allowed, allowed_types, dynamic, intern_threshold, fixed_type FROM variant._registered WHERE variant_typmod = $1";
+
+	/* command, nargs, Oid *argument_types, *values, *nulls, read_only, count */
+	if( (ret = SPI_execute_with_args( cmd, all ? 0 : 1, types, values, " ", true, 0 )) != SPI_OK_SELECT )
+		elog( ERROR, "SPI_execute_with_args(%s) returned %s", cmd, SPI_result_code_string(ret));
+	Assert( SPI_tuptable );
+
+	if ( !all && SPI_processed > 1 )
+		ereport(ERROR,
+			( errmsg( "Got " UINT64_FORMAT " records for variant typmod %i", (uint64) SPI_processed, typmod ),
+				errhint( "This means _variant._registered is corrupted" )
+			)
+		);
+
+	/* Note 0 vs 1 based numbering */
+	Assert(SPI_tuptable->tupdesc->attrs[1]->atttypid == VARCHAROID);
+	Assert(SPI_tuptable->tupdesc->attrs[2]->atttypid == BOOLOID);
+	Assert(SPI_tuptable->tupdesc->attrs[3]->atttypid == BOOLOID);
+
+	for (row = 0; row < SPI_processed; row++)
+	{
+		HeapTuple					tup = SPI_tuptable->vals[row];
+		TupleDesc					tupdesc = SPI_tuptable->tupdesc;
+		RegisteredVariant	*rv;
+		bool							isnull;
+		int								key;
+		Datum							result;
+		ArrayType					*allowed;
+		Datum							*elems;
+		int								i;
+
+		key = DatumGetInt32( heap_getattr( tup, 1, tupdesc, &isnull ) );
+		result = heap_getattr( tup, 2, tupdesc, &isnull );
+		if( isnull )
+			ereport( ERROR,
+					( errmsg( "Found NULL variant_name for typmod %i", key ),
+						errhint( "This should never happen; is _variant._registered corrupted?" )
+					)
+			);
+
+		rv = hash_search(registry_cache, &key, HASH_ENTER, NULL);
+		rv->variant_name = MemoryContextStrdup(registry_cxt, TextDatumGetCString(result));
+		rv->enabled = DatumGetBool( heap_getattr( tup, 3, tupdesc, &isnull ) );
+		rv->storage_allowed = DatumGetBool( heap_getattr( tup, 4, tupdesc, &isnull ) );
+		rv->dynamic = DatumGetBool( heap_getattr( tup, 6, tupdesc, &isnull ) );
+		result = heap_getattr( tup, 7, tupdesc, &isnull );
+		rv->intern_threshold = isnull ? 0 : DatumGetInt32(result);
+		result = heap_getattr( tup, 8, tupdesc, &isnull );
+		rv->fixed_type = isnull ? InvalidOid : DatumGetObjectId(result);
+		if (OidIsValid(rv->fixed_type))
+			get_typlenbyvalalign(rv->fixed_type, &rv->fixed_typlen, &rv->fixed_typbyval, &rv->fixed_typalign);
+
+		allowed = DatumGetArrayTypeP( heap_getattr( tup, 5, tupdesc, &isnull ) );
+		deconstruct_array(allowed, REGTYPEOID, sizeof(Oid), true, 'i',
+						  &elems, NULL, &rv->nallowed);
+		rv->allowed_types = MemoryContextAlloc(registry_cxt, sizeof(Oid) * Max(rv->nallowed, 1));
+		for (i = 0; i < rv->nallowed; i++)
+			rv->allowed_types[i] = DatumGetObjectId(elems[i]);
+	}
+
+	_SPI_disc(do_pop); /* pfree's all SPI stuff */
+	SLOW_PATH_END(STAT_SPI_GET_VARIANT_NAME, InvalidOid, InvalidOid, start);
+}
+
+/*
+ * registry_reset: Empty the registered variant cache if it's been invalidated
+ */
+static void
+registry_reset(void)
+{
+	HASHCTL		ctl;
+
+	if (registry_valid && registry_cache != NULL)
+		return;
+
+	if (registry_cxt == NULL)
+		registry_cxt = AllocSetContextCreate(CacheMemoryContext, "variant registry cache",
+				ALLOCSET_SMALL_MINSIZE, ALLOCSET_SMALL_INITSIZE, ALLOCSET_SMALL_MAXSIZE);
+	else
+		MemoryContextReset(registry_cxt);
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(int);
+	ctl.entrysize = sizeof(RegisteredVariant);
+	ctl.hash = tag_hash;
+	ctl.hcxt = registry_cxt;
+	registry_cache = hash_create("variant registry cache", 16, &ctl,
+			HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	/* Set before loading anything, so an invalidation during the load sticks */
+	registry_valid = true;
+
+	/* Make sure we'll recognize invalidations for _variant._registered */
+	registry_relid_get();
+}
+
+/*
+ * registry_lookup: Return the registration record for a typmod
+ *
+ * The result is only good until the next call; an invalidation can reset the
+ * cache at that point.
+ */
+static RegisteredVariant *
+registry_lookup(int typmod)
+{
+	RegisteredVariant	*rv;
+
+	registry_reset();
+
+	rv = hash_search(registry_cache, &typmod, HASH_FIND, NULL);
+	if (rv != NULL)
+	{
+		STAT_INCR(STAT_REGISTRY_HIT);
+		return rv;
+	}
+
+	registry_load(typmod, false);
+	rv = hash_search(registry_cache, &typmod, HASH_FIND, NULL);
+	if ( rv == NULL )
+		elog( ERROR, "invalid typmod %i", typmod );
+
+	return rv;
+}
+
+/*
+ * variant_warm_caches: Load everything the first variant call would need
+ *
+ * Only done if we were preloaded, the first time a backend runs a query. See
+ * _PG_init(). We load every registered variant, resolve our own Oids, and look
+ * up the IO information for each type in variant.preload_types so it's in
+ * the system caches.
+ *
+ * This runs ahead of whatever query the user happens to be running, so it
+ * must not make that query fail. Anything that goes wrong (a bad entry in
+ * variant.preload_types, a damaged _variant._registered, ...) is reported as
+ * a WARNING instead, and the caches are filled on demand as usual.
+ */
+static void
+variant_warm_caches(void)
+{
+	MemoryContext		oldcxt = CurrentMemoryContext;
+	ResourceOwner		oldowner = CurrentResourceOwner;
+
+	warm_pending = false;
+
+#if PG_VERSION_NUM >= 90600
+	if (IsParallelWorker())
+		return;
+#endif
+	/* Nothing to do if we're not installed (yet) */
+	if (creating_extension || !OidIsValid(registry_relid_get()))
+		return;
+
+	BeginInternalSubTransaction(NULL);
+	MemoryContextSwitchTo(oldcxt);
+
+	PG_TRY();
+	{
+		warm_caches_load();
+
+		ReleaseCurrentSubTransaction();
+		MemoryContextSwitchTo(oldcxt);
+		CurrentResourceOwner = oldowner;
+	}
+	PG_CATCH();
+	{
+		ErrorData	*edata;
+
+		MemoryContextSwitchTo(oldcxt);
+		edata = CopyErrorData();
+		FlushErrorState();
+
+		RollbackAndReleaseCurrentSubTransaction();
+		MemoryContextSwitchTo(oldcxt);
+		CurrentResourceOwner = oldowner;
+
+		/* We may have stopped part way through loading */
+		registry_valid = false;
+
+		ereport(WARNING,
+				( errcode(edata->sqlerrcode),
+					errmsg( "could not preload variant caches: %s", edata->message )
+				)
+			);
+		FreeErrorData(edata);
+	}
+	PG_END_TRY();
+}
+
+/*
+ * warm_caches_load: Do the work for variant_warm_caches()
+ */
+static void
+warm_caches_load(void)
+{
+	MemoryContext		warm_cxt;
+	MemoryContext		oldcxt;
+	char						*list;
+	char						*name;
+	char						*next;
+
+	warm_cxt = AllocSetContextCreate(CurrentMemoryContext, "variant cache warming",
+			ALLOCSET_SMALL_MINSIZE, ALLOCSET_SMALL_INITSIZE, ALLOCSET_SMALL_MAXSIZE);
+	oldcxt = MemoryContextSwitchTo(warm_cxt);
+
+	getIntOid();
+	registry_reset();
+	registry_load(0, true);
+
+	list = pstrdup(preload_types ? preload_types : "");
+	for (name = list; name != NULL; name = next)
+	{
+		Oid				typid;
+		int32			typmod;
+		int16			typlen;
+		bool			typbyval;
+		char			typalign;
+		char			typdelim;
+		Oid				typioparam;
+		Oid				func;
+		FmgrInfo	flinfo;
+
+		next = strchr(name, ',');
+		if (next != NULL)
+			*next++ = '\0';
+
+		while (isspace((unsigned char) *name))
+			name++;
+		if (*name == '\0')
+			continue;
+
+#if PG_VERSION_NUM >= 160000
+		{
+			ErrorSaveContext	escontext = {T_ErrorSaveContext};
+
+			if (!parseTypeString(name, &typid, &typmod, (Node *) &escontext))
+				typid = InvalidOid;
+		}
+#elif defined(LONG_PARSETYPE)
+		parseTypeString(name, &typid, &typmod, true);
+#else
+		parseTypeString(name, &typid, &typmod);
+#endif
+#ifdef LONG_PARSETYPE
+		if (!OidIsValid(typid))
+		{
+			ereport(WARNING,
+					( errcode(ERRCODE_UNDEFINED_OBJECT),
+						errmsg( "type \"%s\" in variant.preload_types does not exist", name )
+					)
+				);
+			continue;
+		}
+#endif
+
+		get_type_io_data(typid, IOFunc_input, &typlen, &typbyval, &typalign,
+						 &typdelim, &typioparam, &func);
+		fmgr_info(func, &flinfo);
+		get_type_io_data(typid, IOFunc_output, &typlen, &typbyval, &typalign,
+						 &typdelim, &typioparam, &func);
+		fmgr_info(func, &flinfo);
+		format_type_with_typemod(typid, typmod);
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+	MemoryContextDelete(warm_cxt);
+}
+
+/*
+ * variant_cmp_int: Compare two variants
+ */
+static int
+variant_cmp_int(FunctionCallInfo fcinfo)
+{
+	VariantInt	li;
+	VariantInt	ri;
+	int					out;
+	MemoryContext	oldcxt;
+	
+	Assert(fcinfo->flinfo->fn_strict); /* Must not be callable on NULL input */
+
+	/*
+	 * Presumably if both inputs are binary equal then they are in fact equal.
+	 * The only problem is two variants storing NULL would be binary equal but
+	 * can't be treated as-such. Given that issue, it doesn't seem worth trying
+	 * to optimize this.
+	 *
+	 * Note that we're not trying to play tricks with not detoasting or
+	 * un-packing, unlike variant_image_eq().
+	 */
+#ifdef NOT_USED
+	if(VARSIZE(l) == VARSIZE(r)
+			&& memcmp(l, r, VARSIZE(l)) == 0)
+		return 0;
+#endif
+
+	/*
+	 * We don't care about IO function but must specify something
+	 *
+	 * TODO: Improve caching so it will handle more than just one type :(
+	 */
+	/*
+	 * Sorts and index builds compare a lot of variants in one memory context,
+	 * so detoasted copies and payload copies go in scratch space, which is
+	 * reset on every call.
+	 */
+	oldcxt = MemoryContextSwitchTo(get_scratch(fcinfo));
+	li = variant_get_int(fcinfo, 0, IOFunc_input, NULL);
+	ri = variant_get_int(fcinfo, 1, IOFunc_input, NULL);
+	MemoryContextSwitchTo(oldcxt);
+
+	/*
+	 * We need to special-case IS DISTINCT, because it considers NULL to be the
+	 * same as NULL.
+	 */
+	if(fcinfo->flinfo->fn_expr &&
+			IsA(fcinfo->flinfo->fn_expr, DistinctExpr))
+	{
+		if( li->isnull && ri->isnull )
+			return 0;
+		else if( li->isnull || ri->isnull )
+			return -1;
+	}
+	else if(li->isnull || ri->isnull )
+		PG_RETURN_NULL();
+
+	/* TODO: If both variants are of the same type try comparing directly */
+		/* TODO: Support Transform_null_equals */
+
+	/* Do comparison via SPI */
+	/* TODO: cache this */
+	{
+		bool				do_pop;
+		int					ret;
+		char				*cmd;
+		Oid					types[2];
+		Datum				values[2];
+		bool				nulls[2];
+		instr_time	start;
+
+		STAT_INCR(STAT_SPI_CMP);
+		SLOW_PATH_START(start);
+		do_pop = _SPI_conn();
+
+		cmd = "SELECT CASE WHEN $1 = $2 THEN 0 WHEN $1 < $2 THEN -1 ELSE 1 END::int";
+		types[0] = li->typid;
+		values[0] = li->data;
+		nulls[0] = li->isnull;
+		types[1] = ri->typid;
+		values[1] = ri->data;
+		nulls[1] = ri->isnull;
+
+		if( (ret = SPI_execute_with_args(
+						cmd, 2, types, values, nulls,
+						true, /* read-only */
+						0 /* count */
+					)) != SPI_OK_SELECT )
+			elog( ERROR, "SPI_execute_with_args returned %s", SPI_result_code_string(ret));
+
+		/* Note 0 vs 1 based numbering */
+		Assert(SPI_tuptable->tupdesc->attrs[0]->atttypid == INT4OID);
+
+		/* Don't need to copy the tuple because int is pass by value */
+		out = DatumGetInt32( heap_getattr(SPI_tuptable->vals[0], 1, SPI_tuptable->tupdesc, &fcinfo->isnull) );
+
+		_SPI_disc(do_pop);
+		SLOW_PATH_END(STAT_SPI_CMP, li->typid, ri->typid, start);
+	}
+
+	return out;
+}
+
+/*
+ * variant_image_cmp_int: Compare two variants by type and then binary image
+ */
+static int
+variant_image_cmp_int(FunctionCallInfo fcinfo)
+{
+	Variant			l, r;
+	uint				flags;
+	Oid					loid, roid;
+	int					out;
+
+	Assert(fcinfo->flinfo->fn_strict); /* Must not be callable on NULL input */
+	l = PG_GETARG_VARIANT(0);
+	r = PG_GETARG_VARIANT(1);
+
+	loid = get_oid(l, &flags);
+	roid = get_oid(r, &flags);
+
+	if (loid != roid)
+		out = (loid < roid) ? -1 : 1;
+	else if (l->typmod != r->typmod)
+		out = (l->typmod < r->typmod) ? -1 : 1;
+	else
+	{
+		out = memcmp(VARDATA(l), VARDATA(r), Min(VARSIZE(l), VARSIZE(r)) - VARHDRSZ);
+		if (out == 0 && VARSIZE(l) != VARSIZE(r))
+			out = (VARSIZE(l) < VARSIZE(r)) ? -1 : 1;
+	}
+
+	PG_FREE_IF_COPY(l, 0);
+	PG_FREE_IF_COPY(r, 1);
+
+	return out;
+}
+
+/*
+ * variant_type_cmp_int: Compare original type of a variant to a regtype
+ */
+static int
+variant_type_cmp_int(FunctionCallInfo fcinfo)
+{
+	uint				flags;
+	Oid					l, r;
+
+	Assert(fcinfo->flinfo->fn_strict); /* Must not be callable on NULL input */
+	l = get_oid_datum(PG_GETARG_DATUM(0), &flags);
+	r = PG_GETARG_OID(1);
+
+	if (l == r)
+		return 0;
+	return (l < r) ? -1 : 1;
+}
+
+#if PG_VERSION_NUM >= 120000
+/*
+ * partitioned_by_type: Is var's table partitioned on variant.original_type(var)?
+ *
+ * Returns the Oid of variant.original_type() if so, InvalidOid otherwise.
+ */
+static Oid
+partitioned_by_type(PlannerInfo *root, Var *var)
+{
+	RangeTblEntry	*rte;
+	Relation			rel;
+	PartitionKey	partkey;
+	ListCell			*lc;
+	Oid						argtype = exprType((Node *) var);
+	Oid						original_type;
+	Oid						result = InvalidOid;
+
+	if (root->parse == NULL || var->varlevelsup != 0
+			|| var->varno < 1 || var->varno > list_length(root->parse->rtable))
+		return InvalidOid;
+
+	rte = rt_fetch(var->varno, root->parse->rtable);
+	if (rte->rtekind != RTE_RELATION || rte->relkind != RELKIND_PARTITIONED_TABLE)
+		return InvalidOid;
+
+	original_type = LookupFuncName(list_make2(makeString("variant"), makeString("original_type")),
+								   1, &argtype, true);
+	if (!OidIsValid(original_type))
+		return InvalidOid;
+
+	/* The planner already holds a lock on anything in the range table */
+	rel = table_open(rte->relid, NoLock);
+	partkey = RelationGetPartitionKey(rel);
+	if (partkey != NULL && partkey->strategy == PARTITION_STRATEGY_LIST)
+	{
+		foreach(lc, partkey->partexprs)
+		{
+			FuncExpr	*f = (FuncExpr *) lfirst(lc);
+			Var				*arg;
+
+			if (!IsA(f, FuncExpr) || f->funcid != original_type)
+				continue;
+			arg = (Var *) linitial(f->args);
+			if (IsA(arg, Var) && arg->varattno == var->varattno)
+			{
+				result = original_type;
+				break;
+			}
+		}
+	}
+	table_close(rel, NoLock);
+
+	return result;
+}
+#endif
+
+#if PG_VERSION_NUM >= 90500
+static Size
+variant_expanded_get_flat_size(ExpandedObjectHeader *eohptr)
+{
+	ExpandedVariant	*ev = (ExpandedVariant *) eohptr;
+
+	Assert(ev->magic == EXPANDED_VARIANT_MAGIC);
+	return VARSIZE(ev->flat);
+}
+
+static void
+variant_expanded_flatten_into(ExpandedObjectHeader *eohptr,
+							  void *result, Size allocated_size)
+{
+	ExpandedVariant	*ev = (ExpandedVariant *) eohptr;
+
+	Assert(ev->magic == EXPANDED_VARIANT_MAGIC);
+	Assert(allocated_size == VARSIZE(ev->flat));
+	memcpy(result, ev->flat, allocated_size);
+}
+#endif
+
+/*
+ * variant_get_int: Get the VariantInt for a function argument
+ *
+ * If the argument is an expanded variant this returns its decoded form
+ * instead of detoasting and decoding again. In that case *shared is set and
+ * the caller must not free or return vi->data, since it belongs to the
+ * expanded object. shared may be NULL if the caller doesn't do either.
+ */
+static VariantInt
+variant_get_int(FunctionCallInfo fcinfo, int argno, IOFuncSelector func, bool *shared)
+{
+#if PG_VERSION_NUM >= 90500
+	Datum		d = PG_GETARG_DATUM(argno);
+
+	if (VARATT_IS_EXTERNAL_EXPANDED(DatumGetPointer(d)))
+	{
+		ExpandedVariant	*ev = (ExpandedVariant *) DatumGetEOHP(d);
+
+		if (ev->magic == EXPANDED_VARIANT_MAGIC)
+		{
+			VariantInt	vi = palloc(sizeof(VariantDataInt));
+
+			/* Callers expect the cache to be set up for this type */
+			*vi = ev->vi;
+			get_cache(fcinfo, vi, func);
+			STAT_INCR(STAT_EXPANDED_HIT);
+
+			if (shared)
+				*shared = true;
+			return vi;
+		}
+	}
+#endif
+
+	if (shared)
+		*shared = false;
+	/* make_variant_int() decodes compact variants itself */
+	return make_variant_int((Variant) variant_detoast_stored(PG_GETARG_DATUM(argno)), fcinfo, func);
+}
+
+/*
+ * make_variant_int: Converts our external (Variant) representation to a VariantInt.
+ */
+static VariantInt
+make_variant_int(Variant v, FunctionCallInfo fcinfo, IOFuncSelector func)
+{
+	VariantCache	*cache;
+	VariantInt		vi;
+	long 					data_length; /* long instead of size_t because we're subtracting */
+	Pointer 			ptr;
+	uint					flags;
+
+	
+	/* Ensure v is fully detoasted */
+	Assert(!VARATT_IS_EXTENDED(v));
+
+	/* May need to be careful about what context this stuff is palloc'd in */
+	vi = palloc0(sizeof(VariantDataInt));
+
+	/* Decode compact variants directly instead of making a normal one first */
+	if (variant_is_compact((struct varlena *) v))
+	{
+		int16		typlen;
+		bool		typbyval;
+		char		typalign;
+
+		compact_decode((struct varlena *) v, vi, &typlen, &typbyval, &typalign);
+		get_cache(fcinfo, vi, func);
+		return vi;
+	}
+
+	vi->typid = get_oid(v, &flags);
+
+#ifdef VARIANT_TEST_OID
+	vi->typid -= OID_MASK;
+#endif
+
+	vi->typmod = v->typmod;
+	vi->isnull = (flags & VAR_ISNULL ? true : false);
+
+	cache = get_cache(fcinfo, vi, func);
+
+	/*
+	 * by-value type. We do special things with all pass-by-reference when we
+	 * store, so we only use this for typbyval even though fetch_att supports
+	 * pass-by-reference.
+	 *
+	 * Note that fetch_att sanity-checks typlen for us (because we're only passing typbyval).
+	 */
+	if(cache->typbyval)
+	{
+		if(!vi->isnull)
+		{
+			Pointer p = VDATAPTR_ALIGN(v, cache->typalign);
+			vi->data = fetch_att(p, cache->typbyval, cache->typlen);
+		}
+		return vi;
+	}
+
+	/* we don't store a varlena header for varlena data; instead we compute
+	 * it's size based on ours:
+	 *
+	 * Our size - our header size - overflow byte (if present)
+	 *
+	 * For cstring, we don't store the trailing NUL
+	 */
 	data_length = VARSIZE(v) - VHDRSZ - (flags & VAR_OVERFLOW ? 1 : 0);
 	if( data_length < 0 )
 		elog(ERROR, "Negative data_length %li", data_length);
 
-	if (cache->typlen == -1) /* varlena */
+	if (cache->typlen == -1) /* varlena */
+	{
+		ptr = palloc0(data_length + VARHDRSZ);
+		STAT_ADD(STAT_BYTES_COPIED, data_length + VARHDRSZ);
+		SET_VARSIZE(ptr, data_length + VARHDRSZ);
+		memcpy(VARDATA(ptr), VDATAPTR(v), data_length);
+	}
+	else if(cache->typlen == -2) /* cstring */
+	{
+		ptr = palloc(data_length + 1); /* Need space for NUL terminator */
+		STAT_ADD(STAT_BYTES_COPIED, data_length + 1);
+		memcpy(ptr, VDATAPTR(v), data_length);
+		*(ptr + data_length + 1) = '\0';
+	}
+	else /* Fixed size, pass by reference */
+	{
+		if(vi->isnull)
+		{
+			vi->data = (Datum) 0;
+			return vi;
+		}
+
+		Assert(data_length == cache->typlen);
+		ptr = palloc0(data_length);
+		STAT_ADD(STAT_BYTES_COPIED, data_length);
+		Assert(ptr == (char *) att_align_nominal(ptr, cache->typalign));
+		memcpy(ptr, VDATAPTR(v), data_length);
+	}
+	vi->data = PointerGetDatum(ptr);
+
+	return vi;
+}
+
+/*
+ * Create an external variant from our internal representation
+ */
+static Variant
+make_variant(VariantInt vi, FunctionCallInfo fcinfo, IOFuncSelector func)
+{
+	VariantCache	*cache;
+
+	cache = get_cache(fcinfo, vi, func);
+	Assert(cache->typid = vi->typid);
+
+	return make_variant_typ(vi, cache->typlen, cache->typbyval, cache->typalign);
+}
+
+/*
+ * make_variant_typ: make_variant() for callers that already have the type's
+ * storage information
+ */
+static Variant
+make_variant_typ(VariantInt vi, int16 typlen, bool typbyval, char typalign)
+{
+	Variant				v;
+	bool					oid_overflow=OID_TOO_LARGE(vi->typid);
+	long					variant_length, data_length; /* long because we subtract */
+	Pointer				data_ptr = 0;
+	uint					flags = 0;
+
+#ifdef VARIANT_TEST_OID
+	vi->typid += OID_MASK;
+	oid_overflow=OID_TOO_LARGE(vi->typid);
+#endif
+
+	if(vi->isnull)
+	{
+		flags |= VAR_ISNULL;
+		data_length = 0;
+	}
+	else if(typlen == -1) /* varlena */
+	{
+		/*
+		 * Short varlena is OK, but we need to make sure it's not external. It's OK
+		 * to leave compressed varlena's alone too, but detoast_packed will
+		 * uncompress them. We'll just follow rangetype.c's lead here.
+		 */
+		vi->data = PointerGetDatum( PG_DETOAST_DATUM_PACKED(vi->data) );
+		data_ptr = DatumGetPointer(vi->data);
+
+		/*
+		 * Because we don't store varlena aligned or with it's header, our
+		 * data_length is simply the varlena length.
+		 */
+		data_length = VARSIZE_ANY_EXHDR(vi->data);
+		data_ptr = VARDATA_ANY(data_ptr);
+	}
+	else if(typlen == -2) /* cstring */
+	{
+		data_length = strlen(DatumGetCString(vi->data)); /* We don't store NUL terminator */
+		data_ptr = DatumGetPointer(vi->data);
+	}
+	else
+	{
+		Assert(typlen >= 0);
+		if(typbyval)
+		{
+			data_length = VHDRSZ; /* Start with header size to make sure alignment is correct */
+			data_length = (long) VDATAPTR_ALIGN(data_length, typalign);
+			data_length += typlen;
+			data_length -= VHDRSZ;
+		}
+		else /* fixed length, pass by reference */
+		{
+			data_length = typlen;
+			data_ptr = DatumGetPointer(vi->data);
+		}
+	}
+
+	/* If typid is too large then we need an extra byte */
+	variant_length = VHDRSZ + data_length + (oid_overflow ? sizeof(char) : 0);
+	if( variant_length < 0 )
+		elog(ERROR, "Negative variant_length %li", variant_length);
+
+	v = palloc0(variant_length);
+	STAT_ADD(STAT_BYTES_COPIED, variant_length);
+	SET_VARSIZE(v, variant_length);
+	v->pOid = vi->typid;
+	v->typmod = vi->typmod;
+
+	if(oid_overflow)
+	{
+		flags |= VAR_OVERFLOW;
+
+		/* Reset high pOid byte to zero */
+		v->pOid &= 0x00FFFFFF;
+
+		/* Store high byte of OID at the end of our structure */
+		*((char *) v + VARSIZE(v) - 1) = vi->typid >> 24;
+	}
+
+	/*
+	 * Be careful not to overwrite the valid OID data
+	 */
+	v->pOid |= flags;
+	Assert( get_oid(v, &flags) == vi->typid );
+
+	if(!vi->isnull)
+	{
+		if(typbyval)
+		{
+			Pointer p = VDATAPTR_ALIGN(v, typalign);
+			store_att_byval(p, vi->data, typlen);
+		}
+		else
+			memcpy(VDATAPTR(v), data_ptr, data_length);
+	}
+
+	return v;
+}
+
+/*
+ * get_oid: Returns actual Oid from a Variant
+ */
+static Oid
+get_oid(Variant v, uint *flags)
+{
+	*flags = v->pOid & (~OID_MASK);
+
+	if(*flags & VAR_OVERFLOW)
+	{
+		char	e;
+		Oid		o;
+
+		/* fetch the extra byte from datum's last byte */
+		e = *((char *) v + VARSIZE(v) - 1);
+
+		o = ((uint) e) << 24;
+		o |= v->pOid & 0x00FFFFFF;
+		return o;
+	}
+	else
+		return v->pOid & OID_MASK;
+}
+
+/*
+ * get_oid_datum: Returns original type Oid of a (possibly toasted) variant
+ *
+ * Unlike get_oid() this only fetches as much of the datum as it needs, which
+ * normally is just our header. If the Oid overflowed then the high byte is
+ * at the end of the datum and we have to detoast the whole thing.
+ */
+static Oid
+get_oid_datum(Datum d, uint *flags)
+{
+	Variant		v = (Variant) DatumGetPointer(d);
+	Oid				o;
+
+	if (VARATT_IS_EXTENDED(v))
+	{
+		v = (Variant) PG_DETOAST_DATUM_SLICE(d, 0, VHDRSZ - VARHDRSZ);
+		STAT_ADD(STAT_BYTES_DETOASTED, VHDRSZ);
+
+		if (v->pOid & VAR_OVERFLOW)
+		{
+			pfree(v);
+			v = DatumGetVariantType(d);
+		}
+	}
+
+	/* A compact variant's type comes from the registry; see variant_compact() */
+	if (v->pOid & VAR_VERSION)
+	{
+		*flags = v->pOid & VAR_FLAGMASK;
+		o = registry_lookup(v->pOid & OID_MASK)->fixed_type;
+
+		if ((Pointer) v != DatumGetPointer(d))
+			pfree(v);
+		return o;
+	}
+
+	o = get_oid(v, flags);
+
+	if ((Pointer) v != DatumGetPointer(d))
+		pfree(v);
+
+#ifdef VARIANT_TEST_OID
+	o -= OID_MASK;
+#endif
+
+	return o;
+}
+
+/*
+ * get_cache: get/set cached info
+ */
+static VariantCache *
+get_cache(FunctionCallInfo fcinfo, VariantInt vi, IOFuncSelector func)
+{
+	VariantCache *cache = (VariantCache *) fcinfo->flinfo->fn_extra;
+
+	/* IO type should always be the same, so assert that. But if we're not an assert build just force a reset. */
+	if (cache != NULL && cache->typid == vi->typid && cache->typmod == vi->typmod && cache->IOfunc != func)
+	{
+		Assert(false);
+		cache->typid ^= vi->typid;
+	}
+
+	if (cache == NULL || cache->typid != vi->typid || cache->typmod != vi->typmod)
+	{
+		char						typDelim;
+		Oid							typIoFunc;
+		Oid							evicted = InvalidOid;
+		instr_time			start;
+
+		STAT_INCR(STAT_CACHE_MISS);
+
+		/*
+		 * We can get different OIDs in one call, so don't needlessly palloc
+		 */
+		if (cache == NULL)
+			cache = (VariantCache *) MemoryContextAllocZero(fcinfo->flinfo->fn_mcxt,
+												   sizeof(VariantCache));
+		else if (OidIsValid(cache->typid)) /* get_scratch() can create an empty cache */
+		{
+			STAT_INCR(STAT_CACHE_EVICTION);
+			evicted = cache->typid;
+			SLOW_PATH_START(start);
+
+			/* fn_mcxt lives as long as the call site, so don't leak into it */
+			if (cache->formatted_name != NULL)
+				pfree(cache->formatted_name);
+			if (cache->out_prefix != NULL)
+				pfree(cache->out_prefix);
+		}
+
+		cache->typid = vi->typid;
+		cache->typmod = vi->typmod;
+		cache->IOfunc = func;
+
+		get_type_io_data(cache->typid,
+							 func,
+							 &cache->typlen,
+							 &cache->typbyval,
+							 &cache->typalign,
+							 &typDelim,
+							 &cache->typioparam,
+							 &typIoFunc);
+		fmgr_info_cxt(typIoFunc, &cache->proc, fcinfo->flinfo->fn_mcxt);
+
+		if (func == IOFunc_output || func == IOFunc_send)
+		{
+			/*
+			 * Everything up to the value is the same for every call, so build it
+			 * once here instead of in variant_out_int.
+			 */
+			char						*name;
+			size_t					len;
+			StringInfoData	prefix;
+			char						*tmp;
+
+			cache->formatted_name = MemoryContextStrdup(fcinfo->flinfo->fn_mcxt,
+					format_type_with_typemod(cache->typid, cache->typmod));
+			name = cache->formatted_name;
+			len = strlen(name);
+
+			initStringInfo(&prefix);
+			appendStringInfoChar(&prefix, '(');
+			if (variant_quote_scan(name, len) == len)
+				appendBinaryStringInfo(&prefix, name, len);
+			else
+			{
+				appendStringInfoChar(&prefix, '"');
+				for (tmp = name; *tmp; tmp++)
+				{
+					char		ch = *tmp;
+
+					if (ch == '"' || ch == '\\')
+						appendStringInfoCharMacro(&prefix, ch);
+					appendStringInfoCharMacro(&prefix, ch);
+				}
+				appendStringInfoChar(&prefix, '"');
+			}
+			appendStringInfoChar(&prefix, ',');
+
+			cache->out_prefix_len = prefix.len;
+			cache->out_prefix = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt, prefix.len + 1);
+			memcpy(cache->out_prefix, prefix.data, prefix.len + 1);
+			pfree(prefix.data);
+		}
+		else
+		{
+			cache->formatted_name = NULL;
+			cache->out_prefix = NULL;
+			cache->out_prefix_len = 0;
+		}
+
+		fcinfo->flinfo->fn_extra = (void *) cache;
+
+		if (OidIsValid(evicted))
+			SLOW_PATH_END(STAT_CACHE_EVICTION, evicted, vi->typid, start);
+	}
+	else
+		STAT_INCR(STAT_CACHE_HIT);
+
+	return cache;
+}
+
+/*
+ * get_scratch: Return the call site's scratch memory context
+ *
+ * The context is reset every time this is called, so anything allocated in it
+ * is only good until the next call through the same FmgrInfo. Use it for
+ * things that would otherwise pile up in the caller's context, like detoasted
+ * copies and SPI leftovers, but never for anything we return.
+ */
+static MemoryContext
+get_scratch(FunctionCallInfo fcinfo)
+{
+	VariantCache *cache = GetCache(fcinfo);
+
+	if (cache == NULL)
+	{
+		/* typid of InvalidOid makes get_cache() fill this in */
+		cache = (VariantCache *) MemoryContextAllocZero(fcinfo->flinfo->fn_mcxt,
+											   sizeof(VariantCache));
+		fcinfo->flinfo->fn_extra = (void *) cache;
+	}
+
+	if (cache->scratch == NULL)
+		cache->scratch = AllocSetContextCreate(fcinfo->flinfo->fn_mcxt, "variant scratch",
+				ALLOCSET_SMALL_MINSIZE, ALLOCSET_SMALL_INITSIZE, ALLOCSET_SMALL_MAXSIZE);
+	else
+		MemoryContextReset(cache->scratch);
+
+	return cache->scratch;
+}
+
+
+StringInfo
+quote_variant_name_cstring(const char *variant_name)
+{
+	StringInfo			out = makeStringInfo();
+	bool						need_quote;
+	const char			*tmp;
+
+	appendStringInfoChar(out, '(');
+	need_quote = false;
+	for (tmp = variant_name; *tmp; tmp++)
+	{
+		const char		ch = *tmp;
+
+		if (ch == '"' || ch == '(' || ch == ')' || ch == ',' ||
+			isspace((unsigned char) ch))
+		{
+			need_quote = true;
+			break;
+		}
+	}
+	if(!need_quote)
+		appendStringInfoString(out, variant_name);
+	else
+	{
+		appendStringInfoChar(out, '"');
+		for (tmp = variant_name; *tmp; tmp++)
+		{
+			const char		ch = *tmp;
+
+			if (ch == '"')
+				appendStringInfoCharMacro(out, ch);
+			appendStringInfoCharMacro(out, ch);
+		}
+		appendStringInfoChar(out, '"');
+	}
+	appendStringInfoChar(out, ')');
+
+	return out;
+}
+
+
+Oid
+getIntOid()
+{
+	Oid		out;
+	int		ret;
+	bool	isnull;
+	bool	do_pop = false;
+	instr_time	start;
+
+	if (OidIsValid(int_type_oid))
+		return int_type_oid;
+
+	STAT_INCR(STAT_SPI_GET_INT_OID);
+	SLOW_PATH_START(start);
+	do_pop = _SPI_conn();
+
+	/*
+	 * Get OID of our internal data type. This is necessary because record_in and
+	 * record_out need it.
+	 */
+	if ( (ret = SPI_execute("SELECT 'variant._variant'::regtype::oid", true, 1)) != SPI_OK_SELECT )
+		elog( ERROR, "SPI_execute returned %s", SPI_result_code_string(ret));
+
+	/* Don't need to copy the tuple because Oid is pass by value */
+	out = DatumGetObjectId( heap_getattr(SPI_tuptable->vals[0], 1, SPI_tuptable->tupdesc, &isnull) );
+
+	/* Remember this frees everything palloc'd since our connect/push call */
+	_SPI_disc(do_pop);
+	SLOW_PATH_END(STAT_SPI_GET_INT_OID, InvalidOid, InvalidOid, start);
+
+	/* Only cache it if we'll find out about the extension being dropped */
+	if (OidIsValid(registry_relid_get()))
+		int_type_oid = out;
+
+	return out;
+}
+
+/*
+ * cbor_put_head: Append a CBOR initial byte and argument
+ */
+static void
+cbor_put_head(StringInfo buf, int major, uint64 val)
+{
+	int			nbytes;
+	int			i;
+
+	if (val < 24)
 	{
-		ptr = palloc0(data_length + VARHDRSZ);
-		SET_VARSIZE(ptr, data_length + VARHDRSZ);
-		memcpy(VARDATA(ptr), VDATAPTR(v), data_length);
+		appendStringInfoCharMacro(buf, (char) (major << 5 | val));
+		return;
 	}
-	else if(cache->typlen == -2) /* cstring */
+
+	if (val <= 0xFF)
 	{
-		ptr = palloc(data_length + 1); /* Need space for NUL terminator */
-		memcpy(ptr, VDATAPTR(v), data_length);
-		*(ptr + data_length + 1) = '\0';
+		appendStringInfoCharMacro(buf, (char) (major << 5 | 24));
+		nbytes = 1;
 	}
-	else /* Fixed size, pass by reference */
+	else if (val <= 0xFFFF)
 	{
-		if(vi->isnull)
-		{
-			vi->data = (Datum) 0;
-			return vi;
-		}
+		appendStringInfoCharMacro(buf, (char) (major << 5 | 25));
+		nbytes = 2;
+	}
+	else if (val <= 0xFFFFFFFF)
+	{
+		appendStringInfoCharMacro(buf, (char) (major << 5 | 26));
+		nbytes = 4;
+	}
+	else
+	{
+		appendStringInfoCharMacro(buf, (char) (major << 5 | 27));
+		nbytes = 8;
+	}
 
-		Assert(data_length == cache->typlen);
-		ptr = palloc0(data_length);
-		Assert(ptr == (char *) att_align_nominal(ptr, cache->typalign));
-		memcpy(ptr, VDATAPTR(v), data_length);
+	/* Big endian */
+	for (i = nbytes - 1; i >= 0; i--)
+		appendStringInfoCharMacro(buf, (char) ((val >> (i * 8)) & 0xFF));
+}
+
+static void
+cbor_put_int(StringInfo buf, int64 val)
+{
+	if (val >= 0)
+		cbor_put_head(buf, CBOR_UINT, (uint64) val);
+	else
+		cbor_put_head(buf, CBOR_NEGINT, (uint64) (-(val + 1)));
+}
+
+static void
+cbor_put_string(StringInfo buf, int major, const char *str, Size len)
+{
+	cbor_put_head(buf, major, len);
+	appendBinaryStringInfo(buf, str, len);
+}
+
+/*
+ * cbor_put_type: Append the type of a variant
+ *
+ * name is the formatted type name if the caller already has it.
+ */
+static void
+cbor_put_type(StringInfo buf, Oid typid, int typmod, const char *name)
+{
+	/*
+	 * Only Oids assigned from the catalog data files are the same in every
+	 * database; initdb creates other objects (like the information_schema
+	 * types) after that.
+	 */
+#ifdef FirstGenbkiObjectId
+	if (typid < FirstGenbkiObjectId && typmod == -1)
+#else
+	if (typid < FirstBootstrapObjectId && typmod == -1)
+#endif
+	{
+		cbor_put_head(buf, CBOR_UINT, typid);
+		return;
 	}
-	vi->data = PointerGetDatum(ptr);
 
-	return vi;
+	if (name == NULL)
+		name = format_type_with_typemod(typid, typmod);
+	cbor_put_string(buf, CBOR_TEXT, name, strlen(name));
 }
 
 /*
- * Create an external variant from our internal representation
+ * cbor_put_variant: Append one variant. See comments above variant_to_cbor.
  */
-static Variant
-make_variant(VariantInt vi, FunctionCallInfo fcinfo, IOFuncSelector func)
+static void
+cbor_put_variant(FunctionCallInfo fcinfo, StringInfo buf, Variant v)
 {
 	VariantCache	*cache;
-	Variant				v;
-	bool					oid_overflow=OID_TOO_LARGE(vi->typid);
-	long					variant_length, data_length; /* long because we subtract */
-	Pointer				data_ptr = 0;
-	uint					flags = 0;
+	VariantInt		vi;
+	uint					flags;
+	Oid						typid;
 
-	cache = get_cache(fcinfo, vi, func);
-	Assert(cache->typid = vi->typid);
+	cbor_put_head(buf, CBOR_ARRAY, 2);
 
+	typid = get_oid(v, &flags);
 #ifdef VARIANT_TEST_OID
-	vi->typid += OID_MASK;
-	oid_overflow=OID_TOO_LARGE(vi->typid);
+	typid -= OID_MASK;
 #endif
 
-	if(vi->isnull)
+	/* Strings and bytea can be copied straight out of our payload */
+	if (!(flags & VAR_ISNULL) &&
+			(typid == TEXTOID || typid == VARCHAROID || typid == BPCHAROID || typid == BYTEAOID))
 	{
-		flags |= VAR_ISNULL;
-		data_length = 0;
+		cbor_put_type(buf, typid, v->typmod, NULL);
+		cbor_put_string(buf, typid == BYTEAOID ? CBOR_BYTES : CBOR_TEXT, VDATAPTR(v),
+				VARSIZE(v) - VHDRSZ - (flags & VAR_OVERFLOW ? 1 : 0));
+		return;
 	}
-	else if(cache->typlen == -1) /* varlena */
+
+	vi = make_variant_int(v, fcinfo, IOFunc_output);
+	cache = GetCache(fcinfo);
+	cbor_put_type(buf, vi->typid, vi->typmod, cache->formatted_name);
+
+	if (vi->isnull)
 	{
-		/*
-		 * Short varlena is OK, but we need to make sure it's not external. It's OK
-		 * to leave compressed varlena's alone too, but detoast_packed will
-		 * uncompress them. We'll just follow rangetype.c's lead here.
-		 */
-		vi->data = PointerGetDatum( PG_DETOAST_DATUM_PACKED(vi->data) );
-		data_ptr = DatumGetPointer(vi->data);
+		appendStringInfoCharMacro(buf, CBOR_NULL);
+		return;
+	}
 
-		/*
-		 * Because we don't store varlena aligned or with it's header, our
-		 * data_length is simply the varlena length.
-		 */
-		data_length = VARSIZE_ANY_EXHDR(vi->data);
-		data_ptr = VARDATA_ANY(data_ptr);
+	switch (vi->typid)
+	{
+		case BOOLOID:
+			appendStringInfoCharMacro(buf, DatumGetBool(vi->data) ? CBOR_TRUE : CBOR_FALSE);
+			break;
+		case INT2OID:
+			cbor_put_int(buf, DatumGetInt16(vi->data));
+			break;
+		case INT4OID:
+			cbor_put_int(buf, DatumGetInt32(vi->data));
+			break;
+		case INT8OID:
+			cbor_put_int(buf, DatumGetInt64(vi->data));
+			break;
+		case FLOAT4OID:
+			{
+				union { float4 f; uint32 i; } u;
+
+				u.f = DatumGetFloat4(vi->data);
+				appendStringInfoCharMacro(buf, CBOR_FLOAT4);
+				appendStringInfoCharMacro(buf, (char) (u.i >> 24));
+				appendStringInfoCharMacro(buf, (char) (u.i >> 16));
+				appendStringInfoCharMacro(buf, (char) (u.i >> 8));
+				appendStringInfoCharMacro(buf, (char) u.i);
+			}
+			break;
+		case FLOAT8OID:
+			{
+				union { float8 f; uint64 i; } u;
+				int		i;
+
+				u.f = DatumGetFloat8(vi->data);
+				appendStringInfoCharMacro(buf, CBOR_FLOAT8);
+				for (i = 7; i >= 0; i--)
+					appendStringInfoCharMacro(buf, (char) (u.i >> (i * 8)));
+			}
+			break;
+		default:
+			{
+				char	*str = OutputFunctionCall(&cache->proc, vi->data);
+
+				cbor_put_string(buf, CBOR_TEXT, str, strlen(str));
+				pfree(str);
+			}
+			break;
 	}
-	else if(cache->typlen == -2) /* cstring */
+}
+
+static bytea *
+cbor_to_bytea(StringInfo buf)
+{
+	bytea		*out = palloc(VARHDRSZ + buf->len);
+
+	SET_VARSIZE(out, VARHDRSZ + buf->len);
+	memcpy(VARDATA(out), buf->data, buf->len);
+	pfree(buf->data);
+
+	return out;
+}
+
+static void
+cbor_need(CborReader *r, Size n)
+{
+	if ((Size) (r->end - r->p) < n)
+		ereport(ERROR,
+				( errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+					errmsg( "invalid variant CBOR: unexpected end of data" )
+				)
+			);
+}
+
+/*
+ * cbor_get_head: Read an initial byte and argument, returning the major type
+ *
+ * Only arrays may be indefinite length. Simple values and floats are
+ * returned as CBOR_SIMPLE with the initial byte in val; the caller reads any
+ * float bytes itself.
+ */
+static int
+cbor_get_head(CborReader *r, uint64 *val, bool *indefinite)
+{
+	uint8		ib;
+	int			major;
+	int			info;
+	int			nbytes;
+
+	cbor_need(r, 1);
+	ib = *r->p++;
+	major = ib >> 5;
+	info = ib & 0x1F;
+	*indefinite = false;
+
+	if (major == CBOR_SIMPLE)
 	{
-		data_length = strlen(DatumGetCString(vi->data)); /* We don't store NUL terminator */
-		data_ptr = DatumGetPointer(vi->data);
+		*val = ib;
+		return major;
+	}
+
+	if (info < 24)
+	{
+		*val = info;
+		return major;
+	}
+
+	switch (info)
+	{
+		case 24: nbytes = 1; break;
+		case 25: nbytes = 2; break;
+		case 26: nbytes = 4; break;
+		case 27: nbytes = 8; break;
+		case CBOR_INDEFINITE:
+			if (major != CBOR_ARRAY)
+				ereport(ERROR,
+						( errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+							errmsg( "invalid variant CBOR: indefinite length is only supported for arrays" )
+						)
+					);
+			*indefinite = true;
+			*val = 0;
+			return major;
+		default:
+			ereport(ERROR,
+					( errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+						errmsg( "invalid variant CBOR: reserved additional information %d", info )
+					)
+				);
+	}
+
+	cbor_need(r, nbytes);
+	*val = 0;
+	while (nbytes-- > 0)
+		*val = (*val << 8) | *r->p++;
+
+	return major;
+}
+
+static bool
+cbor_at_break(CborReader *r)
+{
+	cbor_need(r, 1);
+	if (*r->p != CBOR_BREAK)
+		return false;
+	r->p++;
+	return true;
+}
+
+/*
+ * cbor_get_variant: Read one variant, or CBOR null
+ */
+static Datum
+cbor_get_variant(FunctionCallInfo fcinfo, CborReader *r, int variant_typmod, bool *isnull)
+{
+	VariantInt		vi = palloc0(sizeof(*vi));
+	uint64				val;
+	bool					indefinite;
+	int						major;
+
+	*isnull = false;
+
+	if (r->p < r->end && *r->p == CBOR_NULL)
+	{
+		r->p++;
+		*isnull = true;
+		return (Datum) 0;
+	}
+
+	if (cbor_get_head(r, &val, &indefinite) != CBOR_ARRAY || indefinite || val != 2)
+		ereport(ERROR,
+				( errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+					errmsg( "invalid variant CBOR: expected an array of type and value" )
+				)
+			);
+
+	/* Type */
+	major = cbor_get_head(r, &val, &indefinite);
+	if (major == CBOR_UINT && val <= OID_MAX)
+	{
+		vi->typid = (Oid) val;
+		vi->typmod = -1;
+	}
+	else if (major == CBOR_TEXT)
+	{
+		char	*type_name;
+
+		cbor_need(r, val);
+		type_name = pnstrdup((const char *) r->p, val);
+		r->p += val;
+#ifdef LONG_PARSETYPE
+		parseTypeString(type_name, &vi->typid, &vi->typmod, false);
+#else
+		parseTypeString(type_name, &vi->typid, &vi->typmod);
+#endif
 	}
 	else
+		ereport(ERROR,
+				( errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+					errmsg( "invalid variant CBOR: type must be an Oid or a type name" )
+				)
+			);
+
+	/* Verify we've been handed a valid typmod before doing anything with the value */
+	variant_check_type(variant_typmod, vi->typid);
+
+	/* Value */
+	major = cbor_get_head(r, &val, &indefinite);
+	switch (major)
 	{
-		Assert(cache->typlen >= 0);
-		if(cache->typbyval)
-		{
-			data_length = VHDRSZ; /* Start with header size to make sure alignment is correct */
-			data_length = (long) VDATAPTR_ALIGN(data_length, cache->typalign);
-			data_length += cache->typlen;
-			data_length -= VHDRSZ;
-		}
-		else /* fixed length, pass by reference */
-		{
-			data_length = cache->typlen;
-			data_ptr = DatumGetPointer(vi->data);
-		}
+		case CBOR_UINT:
+		case CBOR_NEGINT:
+			{
+				int64		i;
+
+				if (val > (uint64) INT64CONST(0x7FFFFFFFFFFFFFFF))
+					ereport(ERROR,
+							( errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+								errmsg( "invalid variant CBOR: integer out of range" )
+							)
+						);
+				i = major == CBOR_UINT ? (int64) val : -1 - (int64) val;
+
+				if (vi->typid == INT8OID)
+					vi->data = Int64GetDatum(i);
+				else if (vi->typid == INT4OID && i >= INT_MIN && i <= INT_MAX)
+					vi->data = Int32GetDatum((int32) i);
+				else if (vi->typid == INT2OID && i >= SHRT_MIN && i <= SHRT_MAX)
+					vi->data = Int16GetDatum((int16) i);
+				else
+					ereport(ERROR,
+							( errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+								errmsg( "invalid variant CBOR: integer is not valid for type %s", format_type_be(vi->typid) )
+							)
+						);
+			}
+			break;
+		case CBOR_BYTES:
+		case CBOR_TEXT:
+			cbor_need(r, val);
+			if (vi->typid == TEXTOID || vi->typid == VARCHAROID ||
+					vi->typid == BPCHAROID || vi->typid == BYTEAOID)
+			{
+				if ((major == CBOR_BYTES) != (vi->typid == BYTEAOID))
+					ereport(ERROR,
+							( errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+								errmsg( "invalid variant CBOR: wrong string type for %s", format_type_be(vi->typid) )
+							)
+						);
+				if (major == CBOR_TEXT)
+					pg_verifymbstr((const char *) r->p, val, false);
+
+				/* varchar(n) and char(n) need their length checked (and padded) */
+				if (vi->typmod != -1 && vi->typid != TEXTOID && vi->typid != BYTEAOID)
+				{
+					VariantCache	*cache = get_cache(fcinfo, vi, IOFunc_input);
+
+					vi->data = InputFunctionCall(&cache->proc,
+							pnstrdup((const char *) r->p, val),
+							cache->typioparam, vi->typmod);
+				}
+				else
+					vi->data = PointerGetDatum(cstring_to_text_with_len((const char *) r->p, val));
+			}
+			else if (major == CBOR_TEXT)
+			{
+				VariantCache	*cache = get_cache(fcinfo, vi, IOFunc_input);
+
+				vi->data = InputFunctionCall(&cache->proc,
+						pnstrdup((const char *) r->p, val),
+						cache->typioparam, vi->typmod);
+			}
+			else
+				ereport(ERROR,
+						( errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+							errmsg( "invalid variant CBOR: byte string is not valid for type %s", format_type_be(vi->typid) )
+						)
+					);
+			r->p += val;
+			break;
+		case CBOR_SIMPLE:
+			if (val == CBOR_NULL)
+				vi->isnull = true;
+			else if ((val == CBOR_TRUE || val == CBOR_FALSE) && vi->typid == BOOLOID)
+				vi->data = BoolGetDatum(val == CBOR_TRUE);
+			else if (val == CBOR_FLOAT4 && vi->typid == FLOAT4OID)
+			{
+				union { float4 f; uint32 i; } u;
+
+				cbor_need(r, 4);
+				u.i = (uint32) r->p[0] << 24 | (uint32) r->p[1] << 16 | (uint32) r->p[2] << 8 | r->p[3];
+				r->p += 4;
+				vi->data = Float4GetDatum(u.f);
+			}
+			else if (val == CBOR_FLOAT8 && vi->typid == FLOAT8OID)
+			{
+				union { float8 f; uint64 i; } u;
+				int		i;
+
+				cbor_need(r, 8);
+				u.i = 0;
+				for (i = 0; i < 8; i++)
+					u.i = (u.i << 8) | *r->p++;
+				vi->data = Float8GetDatum(u.f);
+			}
+			else
+				ereport(ERROR,
+						( errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+							errmsg( "invalid variant CBOR: simple value 0x%02x is not valid for type %s",
+								(int) val, format_type_be(vi->typid) )
+						)
+					);
+			break;
+		default:
+			ereport(ERROR,
+					( errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+						errmsg( "invalid variant CBOR: unsupported major type %d for value", major )
+					)
+				);
 	}
 
-	/* If typid is too large then we need an extra byte */
-	variant_length = VHDRSZ + data_length + (oid_overflow ? sizeof(char) : 0);
-	if( variant_length < 0 )
-		elog(ERROR, "Negative variant_length %li", variant_length);
+	return VariantTypeGetDatum(variant_pack(make_variant(vi, fcinfo, IOFunc_input), variant_typmod));
+}
+
+/* Sort key value markers; see sort_key_put_variant */
+#define SORT_KEY_VALUE		0x01
+#define SORT_KEY_NULL			0xFF
+
+/* Numeric classes, in sort order */
+#define SORT_KEY_NUMERIC_NINF		0x00
+#define SORT_KEY_NUMERIC_NEG		0x01
+#define SORT_KEY_NUMERIC_ZERO		0x02
+#define SORT_KEY_NUMERIC_POS		0x03
+#define SORT_KEY_NUMERIC_PINF		0x04
+#define SORT_KEY_NUMERIC_NAN		0x05
+
+/*
+ * sort_key_put_uint: Append nbytes of val, big endian
+ */
+static void
+sort_key_put_uint(StringInfo buf, uint64 val, int nbytes)
+{
+	int		i;
+
+	for (i = nbytes - 1; i >= 0; i--)
+		appendStringInfoCharMacro(buf, (char) ((val >> (i * 8)) & 0xFF));
+}
+
+/*
+ * sort_key_put_int: Append a signed integer. Flipping the sign bit makes
+ * negative numbers sort before positive ones.
+ */
+static void
+sort_key_put_int(StringInfo buf, int64 val, int nbytes)
+{
+	uint64	u = (uint64) val ^ ((uint64) 1 << (nbytes * 8 - 1));
+
+	sort_key_put_uint(buf, u, nbytes);
+}
+
+/*
+ * sort_key_put_float: Append an IEEE float
+ *
+ * Positive numbers just need the sign bit set; negative numbers need all bits
+ * flipped so larger magnitudes sort first. Postgres considers -0 equal to 0,
+ * and all NaNs equal to each other and larger than anything else, so those are
+ * normalized first.
+ */
+static void
+sort_key_put_float(StringInfo buf, float8 val, bool is_float4)
+{
+	uint64	u;
+	int			nbytes = is_float4 ? 4 : 8;
+	uint64	sign = (uint64) 1 << (nbytes * 8 - 1);
+
+	if (val == 0)
+		val = 0;
+
+	if (isnan(val))
+		u = is_float4 ? UINT64CONST(0x7FC00000) : UINT64CONST(0x7FF8000000000000);
+	else if (is_float4)
+	{
+		union { float4 f; uint32 i; } f4;
+
+		f4.f = (float4) val;
+		u = f4.i;
+	}
+	else
+	{
+		union { float8 f; uint64 i; } f8;
+
+		f8.f = val;
+		u = f8.i;
+	}
+
+	if (u & sign)
+		u = ~u;
+	else
+		u |= sign;
+	sort_key_put_uint(buf, u, nbytes);
+}
+
+/*
+ * sort_key_put_numeric: Append a numeric
+ *
+ * The internal numeric format is private to numeric.c, so this works from the
+ * output of numeric_out(). The key is a class byte, then for non-zero finite
+ * numbers the decimal exponent and the significant digits followed by a
+ * terminator. Leading and trailing zeros are dropped, since 1.50 = 1.5. For
+ * negative numbers everything after the class byte is inverted, so larger
+ * magnitudes sort first.
+ */
+static void
+sort_key_put_numeric(StringInfo buf, Datum num)
+{
+	char		*str = DatumGetCString(DirectFunctionCall1(numeric_out, num));
+	char		*p = str;
+	bool		neg = false;
+	int			exponent = 0;
+	bool		seen_point = false;
+	bool		seen_digit = false;
+	int			start;
+	int			ndigits;
+	int			i;
+
+	if (strcmp(str, "NaN") == 0)
+	{
+		appendStringInfoCharMacro(buf, SORT_KEY_NUMERIC_NAN);
+		return;
+	}
+	if (strcmp(str, "Infinity") == 0)
+	{
+		appendStringInfoCharMacro(buf, SORT_KEY_NUMERIC_PINF);
+		return;
+	}
+	if (strcmp(str, "-Infinity") == 0)
+	{
+		appendStringInfoCharMacro(buf, SORT_KEY_NUMERIC_NINF);
+		return;
+	}
 
-	v = palloc0(variant_length);
-	SET_VARSIZE(v, variant_length);
-	v->pOid = vi->typid;
-	v->typmod = vi->typmod;
+	if (*p == '-')
+	{
+		neg = true;
+		p++;
+	}
 
-	if(oid_overflow)
+	/* Reserve the class byte; we don't know if this is zero yet */
+	appendStringInfoCharMacro(buf, 0);
+	start = buf->len;
+	sort_key_put_uint(buf, 0, 4); /* Placeholder for exponent */
+
+	ndigits = 0;
+	for (; *p; p++)
 	{
-		flags |= VAR_OVERFLOW;
+		if (*p == '.')
+		{
+			seen_point = true;
+			continue;
+		}
 
-		/* Reset high pOid byte to zero */
-		v->pOid &= 0x00FFFFFF;
+		if (!seen_digit)
+		{
+			if (*p == '0')
+			{
+				/* Leading zeros after the point move the exponent down */
+				if (seen_point)
+					exponent--;
+				continue;
+			}
+			seen_digit = true;
+		}
 
-		/* Store high byte of OID at the end of our structure */
-		*((char *) v + VARSIZE(v) - 1) = vi->typid >> 24;
+		if (!seen_point)
+			exponent++;
+		appendStringInfoCharMacro(buf, *p);
+		ndigits++;
 	}
 
-	/*
-	 * Be careful not to overwrite the valid OID data
-	 */
-	v->pOid |= flags;
-	Assert( get_oid(v, &flags) == vi->typid );
+	/* Drop trailing zeros */
+	while (ndigits > 0 && buf->data[buf->len - 1] == '0')
+	{
+		buf->len--;
+		ndigits--;
+	}
+	buf->data[buf->len] = '\0';
 
-	if(!vi->isnull)
+	if (ndigits == 0)
 	{
-		if(cache->typbyval)
-		{
-			Pointer p = VDATAPTR_ALIGN(v, cache->typalign);
-			store_att_byval(p, vi->data, cache->typlen);
-		}
-		else
-			memcpy(VDATAPTR(v), data_ptr, data_length);
+		buf->len = start;
+		buf->data[start - 1] = SORT_KEY_NUMERIC_ZERO;
+		buf->data[start] = '\0';
+		pfree(str);
+		return;
 	}
 
-	return v;
+	buf->data[start - 1] = neg ? SORT_KEY_NUMERIC_NEG : SORT_KEY_NUMERIC_POS;
+	/* Overwrite the placeholder; sign bit flipped as in sort_key_put_int */
+	for (i = 0; i < 4; i++)
+		buf->data[start + i] = (char) ((((uint32) exponent ^ 0x80000000) >> ((3 - i) * 8)) & 0xFF);
+	appendStringInfoCharMacro(buf, '\0'); /* Shorter digit strings sort first */
+
+	if (neg)
+		for (i = start; i < buf->len; i++)
+			buf->data[i] = ~buf->data[i];
+
+	pfree(str);
 }
 
 /*
- * get_oid: Returns actual Oid from a Variant
+ * sort_key_put_variant: Append the sort key for a variant
+ *
+ * See comments above variant_sort_key.
  */
-static Oid
-get_oid(Variant v, uint *flags)
+static void
+sort_key_put_variant(StringInfo buf, VariantInt vi)
 {
-	*flags = v->pOid & (~OID_MASK);
+	/* make_variant_int() has already taken care of VARIANT_TEST_OID */
+	Oid		typid = vi->typid;
 
-	if(*flags & VAR_OVERFLOW)
+	sort_key_put_uint(buf, typid, 4);
+	if (vi->isnull)
 	{
-		char	e;
-		Oid		o;
+		appendStringInfoCharMacro(buf, SORT_KEY_NULL);
+		return;
+	}
+	appendStringInfoCharMacro(buf, SORT_KEY_VALUE);
 
-		/* fetch the extra byte from datum's last byte */
-		e = *((char *) v + VARSIZE(v) - 1);
+	switch (typid)
+	{
+		case BOOLOID:
+			appendStringInfoCharMacro(buf, DatumGetBool(vi->data) ? 1 : 0);
+			break;
+		case INT2OID:
+			sort_key_put_int(buf, DatumGetInt16(vi->data), 2);
+			break;
+		case INT4OID:
+		case DATEOID:
+			sort_key_put_int(buf, DatumGetInt32(vi->data), 4);
+			break;
+		case INT8OID:
+			sort_key_put_int(buf, DatumGetInt64(vi->data), 8);
+			break;
+#if PG_VERSION_NUM >= 100000 || defined(HAVE_INT64_TIMESTAMP)
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+		case TIMEOID:
+			sort_key_put_int(buf, DatumGetInt64(vi->data), 8);
+			break;
+#endif
+		case FLOAT4OID:
+			sort_key_put_float(buf, DatumGetFloat4(vi->data), true);
+			break;
+		case FLOAT8OID:
+			sort_key_put_float(buf, DatumGetFloat8(vi->data), false);
+			break;
+		case NUMERICOID:
+			sort_key_put_numeric(buf, vi->data);
+			break;
+		case UUIDOID:
+			/* uuid_cmp() is a memcmp() of the 16 raw bytes */
+			appendBinaryStringInfo(buf, DatumGetPointer(vi->data), 16);
+			break;
+		case TEXTOID:
+		case VARCHAROID:
+		case BPCHAROID:
+			{
+				text	*t = DatumGetTextPP(vi->data);
+				int		len = VARSIZE_ANY_EXHDR(t);
 
-		o = ((uint) e) << 24;
-		o |= v->pOid & 0x00FFFFFF;
-		return o;
+				/* bpchar comparisons ignore trailing spaces */
+				if (typid == BPCHAROID)
+					while (len > 0 && VARDATA_ANY(t)[len - 1] == ' ')
+						len--;
+
+				/* Text can't contain NUL, so NUL terminating is enough */
+				appendBinaryStringInfo(buf, VARDATA_ANY(t), len);
+				appendStringInfoCharMacro(buf, '\0');
+			}
+			break;
+		case BYTEAOID:
+			{
+				bytea	*b = DatumGetByteaPP(vi->data);
+				char	*p = VARDATA_ANY(b);
+				char	*end = p + VARSIZE_ANY_EXHDR(b);
+
+				/* Escape NUL as NUL 0xFF and terminate with NUL NUL */
+				for (; p < end; p++)
+				{
+					appendStringInfoCharMacro(buf, *p);
+					if (*p == '\0')
+						appendStringInfoCharMacro(buf, (char) 0xFF);
+				}
+				appendStringInfoCharMacro(buf, '\0');
+				appendStringInfoCharMacro(buf, '\0');
+			}
+			break;
+		default:
+			ereport(ERROR,
+					( errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg( "no sort key encoding for type %s", format_type_be(typid) )
+					)
+				);
 	}
-	else
-		return v->pOid & OID_MASK;
 }
 
 /*
- * get_cache: get/set cached info
+ * variant_detoast_datum: PG_DETOAST_DATUM() that keeps track of detoasting
  */
-static VariantCache *
-get_cache(FunctionCallInfo fcinfo, VariantInt vi, IOFuncSelector func)
+struct varlena *
+variant_detoast_datum(Datum d)
 {
-	VariantCache *cache = (VariantCache *) fcinfo->flinfo->fn_extra;
+	struct varlena	*v = variant_detoast_stored(d);
 
-	/* IO type should always be the same, so assert that. But if we're not an assert build just force a reset. */
-	if (cache != NULL && cache->typid == vi->typid && cache->typmod == vi->typmod && cache->IOfunc != func)
+	if (variant_is_compact(v))
+		v = (struct varlena *) compact_expand(v);
+
+	return v;
+}
+
+/*
+ * variant_detoast_stored: variant_detoast_datum() that leaves compact
+ * variants alone
+ */
+static struct varlena *
+variant_detoast_stored(Datum d)
+{
+	struct varlena	*v = (struct varlena *) DatumGetPointer(d);
+
+	if (VARATT_IS_EXTENDED(v))
 	{
-		Assert(false);
-		cache->typid ^= vi->typid;
+		v = pg_detoast_datum(v);
+		STAT_ADD(STAT_BYTES_DETOASTED, VARSIZE(v));
 	}
 
-	if (cache == NULL || cache->typid != vi->typid || cache->typmod != vi->typmod)
-	{
-		char						typDelim;
-		Oid							typIoFunc;
+	if (variant_is_interned(v))
+		v = (struct varlena *) intern_resolve(v);
 
-		/*
-		 * We can get different OIDs in one call, so don't needlessly palloc
-		 */
-		if (cache == NULL)
-			cache = (VariantCache *) MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
-												   sizeof(VariantCache));
+	return v;
+}
 
-		cache->typid = vi->typid;
-		cache->typmod = vi->typmod;
-		cache->IOfunc = func;
+/*
+ * variant_detoast_packed: PG_DETOAST_DATUM_PACKED() that resolves interned
+ * payloads
+ */
+static Variant
+variant_detoast_packed(Datum d)
+{
+	struct varlena	*v = PG_DETOAST_DATUM_PACKED(d);
 
-		get_type_io_data(cache->typid,
-							 func,
-							 &cache->typlen,
-							 &cache->typbyval,
-							 &cache->typalign,
-							 &typDelim,
-							 &cache->typioparam,
-							 &typIoFunc);
-		fmgr_info_cxt(typIoFunc, &cache->proc, fcinfo->flinfo->fn_mcxt);
+	if (variant_is_compact(v))
+		return compact_expand(v);
+	if (variant_is_interned(v))
+		return intern_resolve(v);
 
-		if (func == IOFunc_output || func == IOFunc_send)
+	return (Variant) v;
+}
+
+/*
+ * stats_flush: Add what's changed in local_stats to shared_stats
+ */
+static void
+stats_flush(void)
+{
+	int		i;
+	bool	changed = false;
+
+	if (shared_stats == NULL)
+		return;
+
+	for (i = 0; i < NUM_STATS; i++)
+		if (local_stats[i] != local_stats_flushed[i])
 		{
-			cache->formatted_name = MemoryContextStrdup(fcinfo->flinfo->fn_mcxt,
-					format_type_with_typemod(cache->typid, cache->typmod));
+			changed = true;
+			break;
 		}
-		else
-			cache->formatted_name="\0";
+	if (!changed)
+		return;
 
-		fcinfo->flinfo->fn_extra = (void *) cache;
+	SpinLockAcquire(&shared_stats->mutex);
+	for (i = 0; i < NUM_STATS; i++)
+		shared_stats->stats[i] += local_stats[i] - local_stats_flushed[i];
+	SpinLockRelease(&shared_stats->mutex);
+
+	memcpy(local_stats_flushed, local_stats, sizeof(local_stats));
+}
+
+/*
+ * slow_path_record: Remember that we just took a slow path
+ */
+static void
+slow_path_record(VariantStat site, Oid type1, Oid type2, instr_time *start)
+{
+	SlowPathKey			key;
+	SlowPathEntry		*entry;
+	bool						found;
+	instr_time			duration;
+
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, *start);
+
+	if (slow_paths == NULL)
+	{
+		HASHCTL		ctl;
+
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(SlowPathKey);
+		ctl.entrysize = sizeof(SlowPathEntry);
+		ctl.hash = tag_hash;
+		ctl.hcxt = TopMemoryContext;
+		slow_paths = hash_create("variant slow paths", 16, &ctl,
+				HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
 	}
 
-	return cache;
+	/* Zero any padding, since the key is hashed as a blob */
+	MemSet(&key, 0, sizeof(key));
+	key.site = site;
+	key.type1 = type1;
+	key.type2 = type2;
+
+	entry = (SlowPathEntry *) hash_search(slow_paths, &key, HASH_ENTER, &found);
+	if (!found)
+	{
+		entry->calls = 0;
+		INSTR_TIME_SET_ZERO(entry->total);
+	}
+	entry->calls++;
+	INSTR_TIME_ADD(entry->total, duration);
 }
 
+/*
+ * slow_path_report: Report everything recorded by slow_path_record()
+ *
+ * This needs catalog access, so it must only be called inside a valid
+ * transaction.
+ */
+static void
+slow_path_report(void)
+{
+	HTAB						*events = slow_paths;
+	HASH_SEQ_STATUS	status;
+	SlowPathEntry		*entry;
+
+	if (events == NULL)
+		return;
+
+	/* Start over even if reporting fails */
+	slow_paths = NULL;
+
+	hash_seq_init(&status, events);
+	while ((entry = (SlowPathEntry *) hash_seq_search(&status)) != NULL)
+		ereport(log_slow_paths_level,
+				( errmsg( "variant slow path %s (%s, %s): " INT64_FORMAT " calls",
+									stat_names[entry->key.site],
+									format_type_be(entry->key.type1),
+									format_type_be(entry->key.type2),
+									entry->calls ),
+					errdetail( "Took %.3f ms.", INSTR_TIME_GET_MILLISEC(entry->total) )
+				)
+			);
+
+	hash_destroy(events);
+}
 
-StringInfo
-quote_variant_name_cstring(const char *variant_name)
+static void
+variant_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
+						 SubTransactionId parentSubid, void *arg)
 {
-	StringInfo			out = makeStringInfo();
-	bool						need_quote;
-	const char			*tmp;
+	DepthSave		*save;
 
-	appendStringInfoChar(out, '(');
-	need_quote = false;
-	for (tmp = variant_name; *tmp; tmp++)
+	switch (event)
 	{
-		const char		ch = *tmp;
+		case SUBXACT_EVENT_START_SUB:
+			save = MemoryContextAlloc(TopTransactionContext, sizeof(DepthSave));
+			save->subid = mySubid;
+			save->executor_depth = executor_depth;
+			save->spi_depth = spi_depth;
+			save->next = depth_saves;
+			depth_saves = save;
+			break;
+		case SUBXACT_EVENT_COMMIT_SUB:
+		case SUBXACT_EVENT_ABORT_SUB:
+			while ((save = depth_saves) != NULL)
+			{
+				depth_saves = save->next;
+				if (save->subid == mySubid)
+				{
+					if (event == SUBXACT_EVENT_ABORT_SUB)
+					{
+						executor_depth = save->executor_depth;
+						spi_depth = save->spi_depth;
+					}
+					pfree(save);
+					break;
+				}
+				pfree(save);
+			}
 
-		if (ch == '"' || ch == '(' || ch == ')' || ch == ',' ||
-			isspace((unsigned char) ch))
-		{
-			need_quote = true;
+			if (event == SUBXACT_EVENT_ABORT_SUB)
+				intern_forget_stored();
+			break;
+		default:
 			break;
-		}
 	}
-	if(!need_quote)
-		appendStringInfoString(out, variant_name);
-	else
+}
+
+static void
+variant_xact_callback(XactEvent event, void *arg)
+{
+	switch (event)
 	{
-		appendStringInfoChar(out, '"');
-		for (tmp = variant_name; *tmp; tmp++)
-		{
-			const char		ch = *tmp;
+		/*
+		 * A prepared transaction's approvals have to be written before it's
+		 * prepared; nothing can run in it after that.
+		 */
+		case XACT_EVENT_PRE_COMMIT:
+		case XACT_EVENT_PRE_PREPARE:
+			approval_flush();
+			slow_path_report();
+			bulk_load_report();
+			break;
+		case XACT_EVENT_COMMIT:
+		case XACT_EVENT_ABORT:
+		case XACT_EVENT_PREPARE:
+			stats_flush();
 
-			if (ch == '"')
-				appendStringInfoCharMacro(out, ch);
-			appendStringInfoCharMacro(out, ch);
-		}
-		appendStringInfoChar(out, '"');
+			/* Anything left over is from a failed query; just forget it */
+			if (slow_paths != NULL)
+			{
+				hash_destroy(slow_paths);
+				slow_paths = NULL;
+			}
+			bulk_load_reset();
+			approval_reset();
+			/* A prepared transaction may still be rolled back */
+			if (event != XACT_EVENT_COMMIT)
+				intern_forget_stored();
+			executor_depth = 0;
+			spi_depth = 0;
+			/* Went away with TopTransactionContext */
+			depth_saves = NULL;
+			break;
+		default:
+			break;
 	}
-	appendStringInfoChar(out, ')');
-
-	return out;
 }
 
+/*
+ * Executor hooks
+ *
+ * These only exist to find the end of top level queries for slow path
+ * reporting. Queries we run through SPI don't count as top level, even if
+ * they happen outside of the executor (ie: during planning).
+ */
+static void
+variant_ExecutorStart(QueryDesc *queryDesc, int eflags)
+{
+	if (warm_pending)
+		variant_warm_caches();
+
+	if (prev_ExecutorStart)
+		prev_ExecutorStart(queryDesc, eflags);
+	else
+		standard_ExecutorStart(queryDesc, eflags);
 
-Oid
-getIntOid()
+	executor_depth++;
+}
+
+static void
+variant_ExecutorEnd(QueryDesc *queryDesc)
 {
-	Oid		out;
-	int		ret;
-	bool	isnull;
-	bool	do_pop = false;
+	executor_depth--;
 
-	do_pop = _SPI_conn();
+	if (prev_ExecutorEnd)
+		prev_ExecutorEnd(queryDesc);
+	else
+		standard_ExecutorEnd(queryDesc);
 
-	/*
-	 * Get OID of our internal data type. This is necessary because record_in and
-	 * record_out need it.
-	 */
-	if ( (ret = SPI_execute("SELECT 'variant._variant'::regtype::oid", true, 1)) != SPI_OK_SELECT )
-		elog( ERROR, "SPI_execute returned %s", SPI_result_code_string(ret));
+	if (executor_depth <= 0 && spi_depth == 0)
+	{
+		executor_depth = 0;
+		slow_path_report();
+		bulk_load_report();
+	}
+}
 
-	/* Don't need to copy the tuple because Oid is pass by value */
-	out = DatumGetObjectId( heap_getattr(SPI_tuptable->vals[0], 1, SPI_tuptable->tupdesc, &isnull) );
+#if PG_VERSION_NUM >= 150000
+static void
+stats_shmem_request(void)
+{
+	if (prev_shmem_request_hook)
+		prev_shmem_request_hook();
 
-	/* Remember this frees everything palloc'd since our connect/push call */
-	_SPI_disc(do_pop);
+	RequestAddinShmemSpace(MAXALIGN(sizeof(VariantSharedStats)));
+}
+#endif
 
-	return out;
+static void
+stats_shmem_startup(void)
+{
+	bool	found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	shared_stats = ShmemInitStruct("variant stats", sizeof(VariantSharedStats), &found);
+	if (!found)
+	{
+		SpinLockInit(&shared_stats->mutex);
+		MemSet(shared_stats->stats, 0, sizeof(shared_stats->stats));
+	}
+	LWLockRelease(AddinShmemInitLock);
 }
 
 static bool
@@ -1193,6 +5506,8 @@ _SPI_conn()
 {
 	int		ret;
 
+	spi_depth++;
+
 	if( SPI_connect() == SPI_OK_CONNECT )
 		return false;
 
@@ -1211,6 +5526,30 @@ _SPI_disc(bool pop)
 		elog( ERROR, "SPI_finish returned %s", SPI_result_code_string(ret));
 	if(pop)
 		SPI_pop();
+
+	spi_depth--;
+}
+
+/*
+ * variant_owner: Returns the owner of our internal objects
+ *
+ * Internal SECURITY DEFINER functions that only C code should call aren't
+ * executable by PUBLIC; we switch to this user to call them.
+ */
+static Oid
+variant_owner(void)
+{
+	Oid				relid = registry_relid_get();
+	HeapTuple	tup;
+	Oid				owner;
+
+	tup = SearchSysCache1(RELOID, ObjectIdGetDatum(relid));
+	if (!HeapTupleIsValid(tup))
+		elog(ERROR, "cache lookup failed for _variant._registered");
+	owner = ((Form_pg_class) GETSTRUCT(tup))->relowner;
+	ReleaseSysCache(tup);
+
+	return owner;
 }
 
 /*
@@ -31,10 +31,11 @@ typedef VariantData *Variant;
  * default cast logic will never call a cast function on a null input, so
  * actually supporting this is someone difficult.
  *
- * Funally, VAR_VERSION is used as an internal version indicator. Currently we
- * only support version 0, but if we didn't reserve space for a version
- * identifier pg_upgrade would be in trouble if we ever needed to change our
- * storage format.
+ * Funally, VAR_VERSION is used as an internal version indicator. Version 0 is
+ * the format above. Version 1 is a "compact" variant of a fixed type
+ * registered variant: the rest of the Packed Oid is the registered variant's
+ * typmod, there is no typmod field, and the payload follows immediately.
+ * See variant_compact().
  *
  * TODO: Further improve efficiency by not storing the varlena size header if
  * typid is a varlena.
@@ -47,6 +48,16 @@ typedef VariantData *Variant;
 #define OID_MASK						0x1FFFFFFF
 #define OID_TOO_LARGE(Oid) (Oid > OID_MASK)
 
+/*
+ * A variant can hold a reference to a payload stored once in
+ * _variant._interned instead of the payload itself. There are no flag bits
+ * to spare, so an interned variant is one with VAR_ISNULL set and a payload,
+ * which a NULL never has. The payload is the SHA-256 of the real payload.
+ * Everything that reads a payload goes through variant_detoast_datum(),
+ * which swaps the real payload back in.
+ */
+#define VAR_INTERNED_LEN		32
+
 
 #define VHDRSZ				(sizeof(VariantData))
 #define VDATAPTR(x)		    ( (Pointer) ( (x) + 1 ) )
@@ -68,8 +79,12 @@ typedef VariantDataInt *VariantInt;
 
 /*
  * fmgr macros for range type objects
+ *
+ * variant_detoast_datum() is PG_DETOAST_DATUM() plus statistics tracking.
  */
-#define DatumGetVariantType(X)		((Variant) PG_DETOAST_DATUM(X))
+extern struct varlena *variant_detoast_datum(Datum d);
+
+#define DatumGetVariantType(X)		((Variant) variant_detoast_datum(X))
 #define DatumGetVariantTypeCopy(X)	((Variant) PG_DETOAST_DATUM_COPY(X))
 #define VariantTypeGetDatum(X)		PointerGetDatum(X)
 #define PG_GETARG_VARIANT(n)			DatumGetVariantType(PG_GETARG_DATUM(n))
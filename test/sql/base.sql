@@ -67,7 +67,7 @@ CREATE TEMP TABLE atypes AS SELECT t::text AS type_name FROM unnest( '{int4,int2
 
 SELECT lives_ok(
 	$test$CREATE TEMP TABLE test_typmod AS
-				SELECT *, ' registration "TEST" (,/) variant '::text AS variant_name, true AS variant_enabled, false AS storage_allowed, '{int4,int2}'::regtype[]
+				SELECT *, ' registration "TEST" (,/) variant '::text AS variant_name, true AS variant_enabled, false AS storage_allowed, '{int4,int2}'::regtype[], false AS dynamic, NULL::int AS intern_threshold, NULL::regtype AS fixed_type
 					FROM variant.register( ' registration "TEST" (,/) variant ', array(SELECT type_name::regtype FROM atypes) ) AS r(variant_typmod)
 	$test$
 	, 'Register variant'
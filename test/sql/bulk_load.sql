@@ -0,0 +1,33 @@
+\set ECHO none
+BEGIN;
+\i test/helpers/tap_setup.sql
+\i test/helpers/common.sql
+
+SET variant.bulk_load = on;
+
+CREATE TEMP TABLE bulk_test(v variant.variant("test variant"));
+
+SELECT plan( (
+  3
+)::int );
+
+-- Should be preceded by a single report for all 100 rows
+SELECT lives_ok(
+  $$INSERT INTO bulk_test SELECT i::variant.variant("test variant") FROM generate_series(1, 100) i$$
+  , 'Bulk load allowed type'
+);
+SELECT is(
+  (SELECT count(*) FROM bulk_test WHERE v @= 'int4')
+  , 100::bigint
+  , 'All rows loaded'
+);
+-- Don't want the report for the rows before the error in the output
+SET client_min_messages = warning;
+SELECT throws_ok(
+  $$INSERT INTO bulk_test SELECT CASE WHEN i < 50 THEN i::variant.variant("test variant") ELSE now()::variant.variant("test variant") END FROM generate_series(1, 100) i$$
+  , '22023'
+  , 'type timestamp with time zone is not allowed in variant.variant(test variant)'
+  , 'Disallowed type still throws error in bulk load mode'
+);
+
+SELECT finish();
@@ -0,0 +1,46 @@
+\set ECHO none
+BEGIN;
+\i test/helpers/tap_setup.sql
+\i test/helpers/common.sql
+
+-- DO so the void result doesn't end up in the output
+DO $do$BEGIN PERFORM pg_temp.su( $$CREATE TYPE public.cast_test AS ENUM( 'a', 'b' )$$ ); END$do$;
+
+CREATE TEMP VIEW cast_test_casts AS
+  SELECT castsource::regtype::text AS source, casttarget::regtype::text AS target
+    FROM pg_cast
+    WHERE castsource IN ( 'cast_test'::regtype, 'cast_test[]'::regtype )
+      OR casttarget IN ( 'cast_test'::regtype, 'cast_test[]'::regtype )
+;
+
+SELECT plan( (
+  3 -- allowlist
+  +2 -- add_types
+)::int );
+
+SELECT lives_ok(
+  $$SELECT pg_temp.su( $su$SELECT variant.create_casts( '{public.cast_test}' )$su$ )$$
+  , 'create_casts() for a list of types'
+);
+SELECT is(
+  (SELECT count(*) FROM cast_test_casts WHERE 'variant.variant' IN (source, target) AND 'cast_test' IN (source, target))
+  , 2::bigint
+  , 'create_casts() created casts in both directions for listed type'
+);
+SELECT is(
+  (SELECT count(*) FROM cast_test_casts WHERE 'cast_test[]' IN (source, target))
+  , 0::bigint
+  , 'create_casts() did not create casts for other types'
+);
+
+SELECT lives_ok(
+  $$SELECT pg_temp.su( $su$SELECT variant.add_types( 'test variant', '{public.cast_test[]}' )$su$ )$$
+  , 'add types to a registered variant'
+);
+SELECT is(
+  (SELECT count(*) FROM cast_test_casts WHERE 'variant.variant' IN (source, target) AND 'cast_test[]' IN (source, target))
+  , 2::bigint
+  , 'add_types() created casts for new types'
+);
+
+SELECT finish();
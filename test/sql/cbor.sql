@@ -0,0 +1,70 @@
+\set ECHO none
+BEGIN;
+\i test/helpers/tap_setup.sql
+\i test/helpers/common.sql
+
+CREATE TEMP TABLE cbor_test AS
+SELECT * FROM (VALUES
+    (1, 42::int::variant.variant("test variant"))
+  , (2, (-9000000000)::bigint::variant.variant("test variant"))
+  , (3, 1.5::float::variant.variant("test variant"))
+  , (4, 'some "text"'::varchar(20)::variant.variant("test variant"))
+  , (5, '((0,0),(1,1))'::box::variant.variant("test variant"))
+  , (6, '(integer,)'::variant.variant("test variant"))
+  , (7, NULL)
+) v(i, v)
+;
+
+SELECT plan( (
+  2 -- to_cbor
+  +3 -- round trip
+  +3 -- errors
+)::int );
+
+SELECT is(
+  variant.to_cbor( 42::int::variant.variant("test variant") )
+  , '\x8217182a'::bytea
+  , 'to_cbor() int'
+);
+SELECT is(
+  variant.to_cbor( 'abc'::text::variant.variant("test variant") )
+  , '\x82181963616263'::bytea
+  , 'to_cbor() text'
+);
+
+SELECT results_eq(
+  $$SELECT i, variant.text_out( variant.from_cbor( variant.to_cbor(v), 'test variant' ) ) FROM cbor_test WHERE v IS NOT NULL ORDER BY i$$
+  , $$SELECT i, variant.text_out(v) FROM cbor_test WHERE v IS NOT NULL ORDER BY i$$
+  , 'from_cbor( to_cbor() ) round trips'
+);
+SELECT is(
+  variant.from_cbor_array( variant.to_cbor( array_agg(v ORDER BY i) ), 'test variant' )::text
+  , array_agg(v ORDER BY i)::text
+  , 'from_cbor_array( to_cbor(array) ) round trips'
+) FROM cbor_test;
+SELECT is(
+  variant.from_cbor_array( variant.cbor_agg(v ORDER BY i), 'test variant' )::text
+  , array_agg(v ORDER BY i)::text
+  , 'from_cbor_array( cbor_agg() ) round trips'
+) FROM cbor_test;
+
+SELECT throws_ok(
+  $$SELECT variant.from_cbor( '\x8217182a00', 'test variant' )$$
+  , '22P03'
+  , 'invalid variant CBOR: 1 bytes of trailing data'
+  , 'from_cbor() rejects trailing data'
+);
+SELECT throws_ok(
+  $$SELECT variant.from_cbor( '\x82746368617261637465722076617279696e6728332966616263646566', 'test variant' )$$
+  , '22001'
+  , 'value too long for type character varying(3)'
+  , 'from_cbor() checks the length of varchar(n)'
+);
+SELECT throws_ok(
+  $$SELECT variant.from_cbor( '\x82181963616263', -1 )$$
+  , '22023'
+  , NULL
+  , 'from_cbor() checks typmod'
+);
+
+SELECT finish();
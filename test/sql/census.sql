@@ -0,0 +1,58 @@
+\set ECHO none
+BEGIN;
+\i test/helpers/tap_setup.sql
+\i test/helpers/common.sql
+
+CREATE TEMP TABLE census_test( v variant.variant("test variant"), i int );
+INSERT INTO census_test(v) VALUES
+  ( 1::int::variant.variant("test variant") )
+  , ( 2::int::variant.variant("test variant") )
+  , ( 'a'::text::variant.variant("test variant") )
+  , ( NULL )
+;
+
+SELECT plan( (
+  4 -- census
+  +3 -- removing types
+)::int );
+
+SELECT results_eq(
+  $$SELECT original_type, row_count FROM variant.type_census( 'census_test', 'v' )$$
+  , $$VALUES ( 'integer'::regtype, 2::bigint ), ( 'text'::regtype, 1::bigint )$$
+  , 'type_census() counts rows by type'
+);
+SELECT is(
+  (SELECT sum(bytes) FROM variant.type_census( 'census_test', 'v' ))
+  , (SELECT sum(pg_column_size(v)) FROM census_test)::numeric
+  , 'type_census() bytes'
+);
+SELECT results_eq(
+  $$SELECT original_type, row_count FROM variant.type_census( 'census_test', 'v', 100 )$$
+  , $$VALUES ( 'integer'::regtype, 2::bigint ), ( 'text'::regtype, 1::bigint )$$
+  , 'type_census() with a 100 percent sample'
+);
+SELECT throws_ok(
+  $$SELECT * FROM variant.type_census( 'census_test', 'i' )$$
+  , '22023'
+  , 'column "i" of relation "census_test" is not a variant'
+  , 'type_census() on a column that is not a variant'
+);
+
+SELECT lives_ok(
+  $$SELECT pg_temp.su( $su$SELECT variant.remove_type( 'test variant', 'int2' )$su$ )$$
+  , 'Can remove a type that is not stored'
+);
+SELECT throws_ok(
+  $$SELECT pg_temp.su( $su$SELECT variant.remove_type( 'test variant', 'int4' )$su$ )$$
+  , '2BP01'
+  , 'variant "test variant" is still in use'
+  , 'Can not remove a type that is stored'
+);
+SELECT throws_ok(
+  $$SELECT pg_temp.su( $su$SELECT variant.storage_allowed( 'test variant', false )$su$ )$$
+  , '2BP01'
+  , 'variant "test variant" is still in use'
+  , 'Can not disallow storage when a column uses the variant'
+);
+
+SELECT finish();
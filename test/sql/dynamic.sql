@@ -0,0 +1,58 @@
+\set ECHO none
+BEGIN;
+\i test/helpers/tap_setup.sql
+\i test/helpers/common.sql
+
+SELECT plan( (
+  4 -- approval
+  +5 -- approve_types
+)::int );
+
+SELECT lives_ok(
+  $$SELECT pg_temp.su( $su$SELECT variant.register( 'dynamic test', '{int}', true, true )$su$ )$$
+  , 'Register dynamic test'
+);
+SELECT lives_ok(
+  $$SELECT 'a'::text::variant.variant("dynamic test"), 'b'::text::variant.variant("dynamic test")$$
+  , 'Unapproved type is allowed in dynamic variant'
+);
+SELECT is(
+  (SELECT allowed_types FROM variant._registered WHERE variant_name = 'dynamic test')
+  , '{int}'::regtype[]
+  , 'Approvals are not written before commit'
+);
+SELECT throws_ok(
+  $$SELECT pg_temp.su( $su$SELECT variant.dynamic( 'DEFAULT', true )$su$ )$$
+  , '22023'
+  , 'Making the DEFAULT variant dynamic is not allowed'
+  , 'DEFAULT variant can not be dynamic'
+);
+
+SELECT lives_ok(
+  $$SELECT pg_temp.su( $su$SELECT _variant.approve_types( variant._registered__get__typmod( 'dynamic test' ), '{text,int}' )$su$ )$$
+  , 'Approve types'
+);
+SELECT is(
+  (SELECT allowed_types FROM variant._registered WHERE variant_name = 'dynamic test')
+  , '{int,text}'::regtype[]
+  , 'Only new types are added'
+);
+SELECT throws_ok(
+  $$SELECT pg_temp.su( $su$SELECT _variant.approve_types( variant._registered__get__typmod( 'test variant' ), '{point}' )$su$ )$$
+  , '22023'
+  , 'type point is not allowed in variant.variant("test variant")'
+  , 'Approve types for non-dynamic variant'
+);
+SELECT is(
+  (SELECT 'point'::regtype = ANY( allowed_types ) FROM variant._registered WHERE variant_name = 'test variant')
+  , false
+  , 'Non-dynamic variant is not changed'
+);
+SELECT throws_ok(
+  $$SELECT variant._approve_types( variant._registered__get__typmod( 'dynamic test' ), '{point}' )$$
+  , '42501'
+  , NULL
+  , 'Only the extension owner can approve types'
+);
+
+SELECT finish();
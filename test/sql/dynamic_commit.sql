@@ -0,0 +1,39 @@
+\set ECHO none
+\i test/helpers/psql.sql
+
+/*
+ * Approvals are only written when a transaction commits, so unlike the other
+ * tests this one commits. Everything it does is undone by dropping the
+ * extension at the end.
+ */
+CREATE EXTENSION variant;
+DO $$BEGIN PERFORM variant.register( 'commit test', '{int}', true, true ); END$$;
+
+DO $$BEGIN PERFORM 'a'::text::variant.variant("commit test"); END$$;
+
+BEGIN;
+DO $$BEGIN PERFORM '(1,1)'::point::variant.variant("commit test"); END$$;
+ROLLBACK;
+
+BEGIN;
+\i test/helpers/tap_setup.sql
+
+SELECT plan( (
+  2
+)::int );
+
+SELECT is(
+  (SELECT allowed_types FROM variant._registered WHERE variant_name = 'commit test')
+  , '{int,text}'::regtype[]
+  , 'Approvals are written at commit'
+);
+SELECT is(
+  (SELECT 'point'::regtype = ANY( allowed_types ) FROM variant._registered WHERE variant_name = 'commit test')
+  , false
+  , 'Approvals are not written on rollback'
+);
+
+SELECT finish();
+ROLLBACK;
+
+DROP EXTENSION variant;
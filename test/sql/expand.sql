@@ -0,0 +1,49 @@
+\set ECHO none
+BEGIN;
+\i test/helpers/tap_setup.sql
+\i test/helpers/common.sql
+
+CREATE FUNCTION pg_temp.loop(p variant.variant, p_loops int) RETURNS text LANGUAGE plpgsql AS $body$
+DECLARE
+  v variant.variant("test variant") := variant.expand(p);
+  r text;
+BEGIN
+  FOR i IN 1..p_loops LOOP
+    r := variant.text_out(v);
+  END LOOP;
+  RETURN r;
+END
+$body$;
+
+CREATE TEMP TABLE expand_test(v variant.variant("test variant"));
+
+SELECT plan( (
+  3 -- basic
+  +1 -- plpgsql
+)::int );
+
+SELECT is(
+  variant.text_out( variant.expand( 42::int::variant.variant("test variant") ) )
+  , '(integer,42)'
+  , 'expand() returns the same value'
+);
+SELECT is(
+  variant.expand( '(integer,)'::variant.variant("test variant") )::int
+  , NULL
+  , 'expand() keeps NULL payloads'
+);
+
+INSERT INTO expand_test VALUES( variant.expand( 'abc'::text::variant.variant("test variant") ) );
+SELECT is(
+  (SELECT variant.text_out(v) FROM expand_test)
+  , '(text,abc)'
+  , 'expanded variants can be stored'
+);
+
+SELECT is(
+  pg_temp.loop( 'some text'::text::variant.variant("test variant"), 10 )
+  , '(text,"some text")'
+  , 'expanded variant in plpgsql'
+);
+
+SELECT finish();
@@ -0,0 +1,62 @@
+\set ECHO none
+BEGIN;
+\i test/helpers/tap_setup.sql
+\i test/helpers/common.sql
+
+SELECT plan( (
+  6 -- storage
+  +3 -- errors
+)::int );
+
+SELECT lives_ok(
+  $$SELECT pg_temp.su( $su$SELECT variant.register( 'fixed test', '{text}', true, p_fixed_type := 'float8' )$su$ )$$
+  , 'Register fixed type variant'
+);
+SELECT is(
+  array( SELECT * FROM variant.allowed_types( 'fixed test' ) )
+  , '{float8,text}'::regtype[]
+  , 'Fixed type is allowed'
+);
+CREATE TEMP TABLE fixed_test(v variant.variant("fixed test"));
+SELECT lives_ok(
+  $$INSERT INTO fixed_test
+      SELECT i::float8::variant.variant("fixed test") FROM generate_series(1, 100) i
+      UNION ALL SELECT 'some text'::text::variant.variant("fixed test")$$
+  , 'Insert fixed and other types'
+);
+SELECT is(
+  (SELECT max(pg_column_size(v)) FROM fixed_test WHERE v @= 'float8')
+  , 13
+  , 'Fixed type values only store the registered variant'
+);
+SELECT is(
+  (SELECT sum(v::float8) FROM fixed_test WHERE v @= 'float8')
+  , 5050::float8
+  , 'Fixed type values read back'
+);
+SELECT is(
+  (SELECT count(*) FROM fixed_test WHERE v = 42::float8::variant.variant("fixed test") OR v = 'some text'::text::variant.variant("fixed test"))
+  , 2::bigint
+  , 'Fixed and other values compare equal'
+);
+
+SELECT throws_ok(
+  $$SELECT pg_temp.su( $su$UPDATE _variant._registered SET fixed_type = 'int4' WHERE variant_name = 'fixed test'$su$ )$$
+  , '22023'
+  , 'Changing the fixed type of a variant is not allowed'
+  , 'Fixed type can not change'
+);
+SELECT throws_ok(
+  $$SELECT pg_temp.su( $su$DELETE FROM _variant._registered WHERE variant_name = 'fixed test'$su$ )$$
+  , '22023'
+  , 'Deleting a fixed type variant is not allowed'
+  , 'Fixed type variant can not be deleted'
+);
+SELECT throws_ok(
+  $$SELECT pg_temp.su( $su$UPDATE _variant._registered SET fixed_type = 'int4' WHERE variant_typmod = -1$su$ )$$
+  , '23514'
+  , 'new row for relation "_registered" violates check constraint "fixed_type_default_variant_not_supported"'
+  , 'DEFAULT variant can not have a fixed type'
+);
+
+SELECT finish();
@@ -0,0 +1,141 @@
+\set ECHO none
+BEGIN;
+\i test/helpers/tap_setup.sql
+\i test/helpers/common.sql
+
+SELECT plan( (
+  6 -- interning
+  +4 -- rollback
+  +2 -- disable
+  +4 -- errors
+)::int );
+
+SELECT lives_ok(
+  $$SELECT pg_temp.su( $su$SELECT variant.register( 'intern test', '{text,bytea}', true )$su$ )
+      , pg_temp.su( $su$SELECT variant.intern_threshold( 'intern test', 100 )$su$ )$$
+  , 'Register intern test'
+);
+CREATE TEMP TABLE intern_test(v variant.variant("intern test"));
+CREATE TRIGGER intern BEFORE INSERT OR UPDATE ON intern_test FOR EACH ROW EXECUTE PROCEDURE variant.intern();
+SELECT lives_ok(
+  $$INSERT INTO intern_test
+      SELECT repeat('x', 1000)::text::variant.variant("intern test") FROM generate_series(1, 100)
+      UNION ALL SELECT 'short'::text::variant.variant("intern test")$$
+  , 'Insert duplicate payloads'
+);
+SELECT cmp_ok(
+  (SELECT max(pg_column_size(v)) FROM intern_test)
+  , '<'
+  , 64
+  , 'Large payloads are stored as references'
+);
+SELECT is(
+  (SELECT count(*) FROM intern_test WHERE v = repeat('x', 1000)::text::variant.variant("intern test"))
+  , 100::bigint
+  , 'Interned payloads compare equal'
+);
+SELECT is(
+  (SELECT DISTINCT v::text FROM intern_test WHERE v != 'short'::text::variant.variant("intern test"))
+  , repeat('x', 1000)
+  , 'Interned payloads read back'
+);
+SELECT cmp_ok(
+  pg_column_size(repeat('z', 1000)::text::variant.variant("intern test"))
+  , '>'
+  , 1000
+  , 'Values are not interned until they are stored'
+);
+
+/*
+ * A value interned in a subtransaction that rolls back must be interned
+ * again when it's stored later
+ */
+SELECT lives_ok(
+  $test$DO $do$
+DECLARE
+  v variant.variant("intern test") := repeat('y', 1000)::text::variant.variant("intern test");
+BEGIN
+  BEGIN
+    INSERT INTO intern_test VALUES( v );
+    RAISE EXCEPTION 'roll back';
+  EXCEPTION WHEN raise_exception THEN
+    NULL;
+  END;
+  INSERT INTO intern_test VALUES( v );
+END
+$do$;
+$test$
+  , 'Store a value after rolling back storing it'
+);
+SELECT is(
+  (SELECT v::text FROM intern_test WHERE v = repeat('y', 1000)::text::variant.variant("intern test"))
+  , repeat('y', 1000)
+  , 'Value stored after a rollback reads back'
+);
+
+/*
+ * Same for a reference read from a row that was rolled back. Our own cache
+ * would still resolve it, so look in _variant._interned.
+ */
+SELECT lives_ok(
+  $test$DO $do$
+DECLARE
+  r variant.variant("intern test");
+BEGIN
+  BEGIN
+    INSERT INTO intern_test VALUES( repeat('w', 1000)::text::variant.variant("intern test") )
+      RETURNING v INTO r;
+    RAISE EXCEPTION 'roll back';
+  EXCEPTION WHEN raise_exception THEN
+    NULL;
+  END;
+  INSERT INTO intern_test VALUES( r );
+END
+$do$;
+$test$
+  , 'Store a reference after rolling back the row it came from'
+);
+RESET ROLE;
+SELECT is(
+  (SELECT count(*) FROM _variant._interned WHERE position( 'wwww'::bytea IN payload ) > 0)
+  , 1::bigint
+  , 'Payload of a copied reference is stored again'
+);
+SET ROLE variant_test_role;
+
+SELECT lives_ok(
+  $$SELECT pg_temp.su( $su$SELECT variant.intern_threshold( 'intern test', NULL )$su$ )$$
+  , 'Turn interning off'
+);
+SELECT is(
+  (SELECT count(*) FROM intern_test WHERE v *= repeat('x', 1000)::text::variant.variant("intern test"))
+  , 100::bigint
+  , 'Existing references still work'
+);
+
+SELECT throws_ok(
+  $$SELECT pg_temp.su( $su$SELECT variant.intern_threshold( 'intern test', 10 )$su$ )$$
+  , '23514'
+  , 'new row for relation "_registered" violates check constraint "intern_threshold_minimum_value"'
+  , 'Threshold must be at least 64 bytes'
+);
+SELECT throws_ok(
+  $$SELECT pg_temp.su( $su$SELECT variant.intern_threshold( 'DEFAULT', 100 )$su$ )$$
+  , '22023'
+  , 'Interning payloads of the DEFAULT variant is not allowed'
+  , 'DEFAULT variant can not intern'
+);
+SELECT throws_ok(
+  $$SELECT variant._intern( 'evil'::bytea )$$
+  , '42501'
+  , NULL
+  , 'Only the extension owner can intern'
+);
+SELECT throws_ok(
+  $$SELECT variant._interned_payload( sha256( 'evil'::bytea ) )$$
+  , '42501'
+  , NULL
+  , 'Only the extension owner can read interned payloads'
+);
+
+SELECT finish();
@@ -0,0 +1,76 @@
+\set ECHO none
+BEGIN;
+\i test/helpers/tap_setup.sql
+\i test/helpers/common.sql
+
+SELECT plan( (
+  5 -- to_jsonb
+  +7 -- from_jsonb
+)::int );
+
+SELECT is(
+  variant.to_jsonb( 42::int::variant.variant("test variant") )
+  , '42'::jsonb
+  , 'to_jsonb() int'
+);
+SELECT is(
+  variant.to_jsonb( 1.50::numeric::variant.variant("test variant") )
+  , '1.50'::jsonb
+  , 'to_jsonb() numeric'
+);
+SELECT is(
+  variant.to_jsonb( 'some "text"'::text::variant.variant("test variant") )
+  , '"some \"text\""'::jsonb
+  , 'to_jsonb() text'
+);
+SELECT is(
+  variant.to_jsonb( '(integer,)'::variant.variant("test variant") )
+  , 'null'::jsonb
+  , 'to_jsonb() NULL payload'
+);
+SELECT is(
+  variant.to_jsonb( '((0,0),(1,1))'::box::variant.variant("test variant") )
+  , '{"type": "box", "value": "(1,1),(0,0)"}'::jsonb
+  , 'to_jsonb() box'
+);
+
+SELECT is(
+  variant.original_type( variant.from_jsonb( '"abc"', 'test variant' ) )
+  , 'text'::regtype
+  , 'from_jsonb() string'
+);
+SELECT is(
+  variant.original_type( variant.from_jsonb( '1.5', 'test variant' ) )
+  , 'numeric'::regtype
+  , 'from_jsonb() number'
+);
+SELECT ok(
+  variant.from_jsonb( 'null', 'test variant' ) IS NULL
+  , 'from_jsonb() null'
+);
+SELECT is(
+  variant.to_jsonb( variant.from_jsonb( '{"type": "box", "value": "(1,1),(0,0)"}', 'test variant' ) )
+  , '{"type": "box", "value": "(1,1),(0,0)"}'::jsonb
+  , 'from_jsonb() tagged object'
+);
+-- "test variant" doesn't allow jsonb, so these error if they aren't tagged
+SELECT throws_ok(
+  $$SELECT variant.from_jsonb( '{"type": "car", "value": 3}', 'test variant' )$$
+  , '22023'
+  , 'type jsonb is not allowed in variant.variant(test variant)'
+  , 'from_jsonb() object with a type and value that is not tagged'
+);
+SELECT throws_ok(
+  $$SELECT variant.from_jsonb( '{"type": "car", "value": "3"}', 'test variant' )$$
+  , '22023'
+  , 'type jsonb is not allowed in variant.variant(test variant)'
+  , 'from_jsonb() object naming a type that does not exist'
+);
+SELECT throws_ok(
+  $$SELECT variant.from_jsonb( '{"type": "integer", "value": "3"}', 'test variant' )$$
+  , '22023'
+  , 'type jsonb is not allowed in variant.variant(test variant)'
+  , 'from_jsonb() object naming a type to_jsonb() never tags'
+);
+
+SELECT finish();
@@ -0,0 +1,35 @@
+\set ECHO none
+BEGIN;
+\i test/helpers/tap_setup.sql
+\i test/helpers/common.sql
+
+-- _variant isn't accessible to variant_test_role
+RESET ROLE;
+CREATE TEMP TABLE memory_bench AS
+  SELECT op, (_variant.bench( op, 12345.678::numeric::variant.variant("test variant"), 10000 )).*
+    FROM unnest( '{variant_cmp_int}'::text[] ) op
+;
+SET ROLE variant_test_role;
+
+SELECT plan( (
+  2
+)::int );
+
+-- bytes_per_op is NULL before 13.0
+SELECT is(
+  (SELECT bytes_per_op IS NOT NULL FROM memory_bench WHERE op = 'variant_cmp_int')
+  , current_setting('server_version_num')::int >= 130000
+  , 'bytes_per_op is measured on 13.0 and up'
+);
+-- See memory_1.out for the output before 13.0
+SELECT CASE WHEN current_setting('server_version_num')::int < 130000
+  THEN skip( 'bytes_per_op is only measured on 13.0 and up', 1 )
+  ELSE cmp_ok(
+    (SELECT bytes_per_op FROM memory_bench WHERE op = 'variant_cmp_int')
+    , '<'
+    , 16::double precision
+    , 'variant_cmp_int() does not accumulate memory'
+  )
+END;
+
+SELECT finish();
@@ -0,0 +1,92 @@
+\set ECHO none
+BEGIN;
+\i test/helpers/tap_setup.sql
+\i test/helpers/common.sql
+
+CREATE TEMP TABLE type_test( v variant.variant("test variant") );
+INSERT INTO type_test
+  SELECT i::int::variant.variant("test variant")
+    FROM generate_series(1, 10) i
+  UNION ALL
+  SELECT i::bigint::variant.variant("test variant")
+    FROM generate_series(1, 5) i
+  UNION ALL
+  SELECT i::text::variant.variant("test variant")
+    FROM generate_series(1, 3) i
+;
+
+SELECT plan( (
+  4 -- Type tests
+  +2 -- Image ordering
+  +2 -- Index plan
+  +3 -- Index
+)::int );
+
+SELECT is(
+  (SELECT count(*) FROM type_test WHERE v @= 'int4')
+  , 10::bigint
+  , 'v @= int4'
+);
+SELECT is(
+  (SELECT count(*) FROM type_test WHERE v @!= 'int4')
+  , 8::bigint
+  , 'v @!= int4'
+);
+SELECT is(
+  (SELECT count(*) FROM type_test WHERE v @= 'int4')
+  , (SELECT count(*) FROM type_test WHERE variant.original_type(v) = 'int4')
+  , 'v @= int4 matches original_type()'
+);
+SELECT is(
+  (SELECT count(*) FROM type_test WHERE v @>= 'int8' AND v @<= 'int4')
+  , 15::bigint
+  , 'type range'
+);
+
+/*
+ * Image ordering
+ */
+SELECT ok(
+  1::bigint::variant.variant("test variant") *< 1::int::variant.variant("test variant")
+  , 'image ordering sorts by type OID first'
+);
+SELECT ok(
+  1::int::variant.variant("test variant") *= 1::int::variant.variant("test variant")
+  , 'image equality'
+);
+
+/*
+ * Index
+ */
+CREATE INDEX type_test__v ON type_test( v variant.btree__variant_type_ops );
+SET enable_seqscan = off;
+SET enable_bitmapscan = off;
+
+SELECT ok(
+  EXISTS(SELECT * FROM pg_temp.exec_text( $$EXPLAIN (COSTS OFF) SELECT * FROM type_test WHERE v @= 'int4'$$ ) t
+    WHERE t ~ 'Index (Only )?Scan using type_test__v')
+  , 'v @= int4 uses index'
+);
+SELECT ok(
+  EXISTS(SELECT * FROM pg_temp.exec_text( $$EXPLAIN (COSTS OFF) SELECT * FROM type_test WHERE v @= 'int4'$$ ) t
+    WHERE t ~ 'Index Cond: \(v @= ')
+  , 'v @= int4 is an index condition'
+);
+
+SELECT is(
+  (SELECT count(*) FROM type_test WHERE v @= 'int4')
+  , 10::bigint
+  , 'v @= int4 with index'
+);
+SELECT is(
+  (SELECT count(*) FROM type_test WHERE v @= 'text')
+  , 3::bigint
+  , 'v @= text with index'
+);
+SELECT is(
+  (SELECT count(*) FROM type_test WHERE v @= 'box')
+  , 0::bigint
+  , 'v @= box with index'
+);
+
+SELECT finish();
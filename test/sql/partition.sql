@@ -0,0 +1,59 @@
+\set ECHO none
+BEGIN;
+\i test/helpers/tap_setup.sql
+\i test/helpers/common.sql
+
+CREATE TEMP TABLE part_type(v variant.variant("test variant")) PARTITION BY LIST (variant.original_type(v));
+CREATE TEMP TABLE part_type_int4 PARTITION OF part_type FOR VALUES IN ('int4');
+CREATE TEMP TABLE part_type_text PARTITION OF part_type FOR VALUES IN ('text');
+INSERT INTO part_type
+  SELECT i::variant.variant("test variant") FROM generate_series(1, 10) i
+  UNION ALL
+  SELECT i::text::variant.variant("test variant") FROM generate_series(1, 5) i
+;
+
+CREATE TEMP TABLE part_hash(v variant.variant("test variant")) PARTITION BY HASH (v);
+CREATE TEMP TABLE part_hash_0 PARTITION OF part_hash FOR VALUES WITH (MODULUS 4, REMAINDER 0);
+CREATE TEMP TABLE part_hash_1 PARTITION OF part_hash FOR VALUES WITH (MODULUS 4, REMAINDER 1);
+CREATE TEMP TABLE part_hash_2 PARTITION OF part_hash FOR VALUES WITH (MODULUS 4, REMAINDER 2);
+CREATE TEMP TABLE part_hash_3 PARTITION OF part_hash FOR VALUES WITH (MODULUS 4, REMAINDER 3);
+INSERT INTO part_hash SELECT * FROM part_type;
+
+SELECT plan( (
+  3 -- type
+  +3 -- hash
+)::int );
+
+SELECT is(
+  (SELECT count(*) FROM part_type WHERE v @= 'int4')
+  , 10::bigint
+  , 'Type test on type partitioned table'
+);
+SELECT is(
+  (SELECT count(*) FROM pg_temp.exec_text( $$EXPLAIN (COSTS OFF) SELECT * FROM part_type WHERE v @= 'text'$$ ) t WHERE t ~ 'part_type_')
+  , 1::bigint
+  , 'Type test prunes type partitions'
+);
+SELECT is(
+  (SELECT count(*) FROM part_type WHERE v @!= 'int4')
+  , 5::bigint
+  , 'Negated type test on type partitioned table'
+);
+
+SELECT is(
+  (SELECT count(*) FROM part_hash)
+  , 15::bigint
+  , 'All rows hash partitioned'
+);
+SELECT is(
+  (SELECT count(*) FROM part_hash WHERE v *= 3::int::variant.variant("test variant"))
+  , 1::bigint
+  , 'Value test on hash partitioned table'
+);
+SELECT is(
+  (SELECT count(*) FROM pg_temp.exec_text( $$EXPLAIN (COSTS OFF) SELECT * FROM part_hash WHERE v *= 3::int::variant.variant("test variant")$$ ) t WHERE t ~ 'part_hash_')
+  , 1::bigint
+  , 'Value test prunes hash partitions'
+);
+
+SELECT finish();
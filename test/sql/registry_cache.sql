@@ -0,0 +1,44 @@
+\set ECHO none
+BEGIN;
+\i test/helpers/tap_setup.sql
+\i test/helpers/common.sql
+
+SELECT plan( (
+  3 -- cached
+  +4 -- invalidation
+)::int );
+
+SELECT lives_ok(
+  $$SELECT pg_temp.su( $su$SELECT variant.register( 'cache test', '{int}', true )$su$ )$$
+  , 'Register cache test'
+);
+SELECT lives_ok(
+  $$SELECT 1::int::variant.variant("cache test"), 2::int::variant.variant("cache test")$$
+  , 'Allowed type works'
+);
+SELECT throws_ok(
+  $$SELECT 'a'::text::variant.variant("cache test")$$
+  , '22023'
+  , 'type text is not allowed in variant.variant(cache test)'
+  , 'Disallowed type throws error'
+);
+
+SELECT lives_ok(
+  $$SELECT pg_temp.su( $su$SELECT variant.add_types( 'cache test', '{text}' )$su$ )$$
+  , 'Add text to cache test'
+);
+SELECT lives_ok(
+  $$SELECT 'a'::text::variant.variant("cache test")$$
+  , 'Added type is allowed after cache invalidation'
+);
+
+SELECT lives_ok(
+  $$SELECT pg_temp.su( $su$SELECT variant.storage_allowed( 'cache test', false )$su$ )$$
+  , 'Disallow storage for cache test'
+);
+SELECT lives_ok(
+  $$SELECT '((0,0),(1,1))'::box::variant.variant("cache test")$$
+  , 'Any type is allowed once storage is not allowed'
+);
+
+SELECT finish();
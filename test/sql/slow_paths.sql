@@ -0,0 +1,41 @@
+\set ECHO none
+BEGIN;
+\i test/helpers/tap_setup.sql
+\i test/helpers/common.sql
+
+-- The timing is in the DETAIL, so leave that out
+\set VERBOSITY terse
+
+CREATE TEMP TABLE slow_test AS
+  SELECT 1::int::variant.variant("test variant") AS i
+    , 1::int::variant.variant("test variant") AS j
+;
+
+SELECT plan( (
+  2 -- settings
+  +2 -- reports
+)::int );
+
+SELECT lives_ok(
+  $$SELECT pg_temp.su('SET LOCAL variant.log_slow_paths_level = notice')$$
+  , 'Report slow paths as NOTICE'
+);
+SELECT lives_ok(
+  $$SELECT pg_temp.su('SET LOCAL variant.log_slow_paths = on')$$
+  , 'Turn on variant.log_slow_paths'
+);
+
+-- Each of these should be followed by a report for one comparison
+SELECT is(
+  (SELECT i = j FROM slow_test)
+  , true
+  , 'Comparison is reported at the end of the query'
+);
+SELECT throws_ok(
+  $$SELECT 1 / (i <> j)::int FROM slow_test$$
+  , '22012'
+  , 'division by zero'
+  , 'Comparison is reported after an error in a subtransaction'
+);
+
+SELECT finish();
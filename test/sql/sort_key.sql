@@ -0,0 +1,76 @@
+\set ECHO none
+BEGIN;
+\i test/helpers/tap_setup.sql
+\i test/helpers/common.sql
+
+CREATE FUNCTION pg_temp.key(variant.variant) RETURNS bytea LANGUAGE sql AS $$
+SELECT variant.sort_key($1)
+$$;
+
+SELECT plan( (
+  4 -- ordering
+  +2 -- equality
+  +1 -- type first
+  +2 -- prefix
+  +1 -- unsupported
+)::int );
+
+SELECT results_eq(
+  $$SELECT i FROM unnest('{5,-2147483648,0,-1,2147483647,42}'::int[]) i ORDER BY pg_temp.key(i::variant.variant("test variant"))$$
+  , $$SELECT i FROM unnest('{5,-2147483648,0,-1,2147483647,42}'::int[]) i ORDER BY i$$
+  , 'int ordering'
+);
+SELECT results_eq(
+  $$SELECT i FROM unnest('{5,-Infinity,0,-1.5,Infinity,NaN,1e-10,-1e300}'::float[]) i ORDER BY pg_temp.key(i::variant.variant("test variant"))$$
+  , $$SELECT i FROM unnest('{5,-Infinity,0,-1.5,Infinity,NaN,1e-10,-1e300}'::float[]) i ORDER BY i$$
+  , 'float ordering'
+);
+SELECT results_eq(
+  $$SELECT i FROM unnest('{10,-100,-1.5,-1.25,-0.001,0,0.0012,0.012,1.5,1.25,NaN,1e20,-12,-123}'::numeric[]) i ORDER BY pg_temp.key(i::variant.variant("test variant"))$$
+  , $$SELECT i FROM unnest('{10,-100,-1.5,-1.25,-0.001,0,0.0012,0.012,1.5,1.25,NaN,1e20,-12,-123}'::numeric[]) i ORDER BY i$$
+  , 'numeric ordering'
+);
+SELECT results_eq(
+  $$SELECT i FROM unnest('{b,a,"",ab,B,abc,aa}'::text[]) i ORDER BY pg_temp.key(i::variant.variant("test variant"))$$
+  , $$SELECT i FROM unnest('{b,a,"",ab,B,abc,aa}'::text[]) i ORDER BY i COLLATE "C"$$
+  , 'text ordering'
+);
+
+SELECT is(
+  pg_temp.key( 1.50::numeric::variant.variant("test variant") )
+  , pg_temp.key( 1.5::numeric::variant.variant("test variant") )
+  , 'equal numerics have equal keys'
+);
+SELECT is(
+  pg_temp.key( '-0'::float::variant.variant("test variant") )
+  , pg_temp.key( '0'::float::variant.variant("test variant") )
+  , '-0 and 0 have equal keys'
+);
+
+SELECT cmp_ok(
+  pg_temp.key( 1000000::int::variant.variant("test variant") )
+  , '<'
+  , pg_temp.key( ''::text::variant.variant("test variant") )
+  , 'keys sort by type first'
+);
+
+SELECT is(
+  length( variant.sort_key( 'abcdef'::text::variant.variant("test variant"), 6 ) )
+  , 6
+  , 'prefix keys are truncated'
+);
+SELECT cmp_ok(
+  variant.sort_key( 'abcdef'::text::variant.variant("test variant"), 7 )
+  , '<='
+  , variant.sort_key( 'abd'::text::variant.variant("test variant"), 7 )
+  , 'prefix keys are in order'
+);
+
+SELECT throws_ok(
+  $$SELECT variant.sort_key( '((0,0),(1,1))'::box::variant.variant("test variant") )$$
+  , '0A000'
+  , 'no sort key encoding for type box'
+  , 'unsupported types throw an error'
+);
+
+SELECT finish();
@@ -0,0 +1,44 @@
+\set ECHO none
+BEGIN;
+\i test/helpers/tap_setup.sql
+\i test/helpers/common.sql
+
+SELECT plan( (
+  2 -- reset
+  +3 -- counters
+)::int );
+
+SELECT lives_ok(
+  $$SELECT variant.stats_reset()$$
+  , 'Reset backend statistics'
+);
+SELECT is(
+  (SELECT sum(backend) FROM variant.stats)
+  , 0::numeric
+  , 'All counters are zero after reset'
+);
+
+CREATE TEMP TABLE stats_test AS
+  SELECT 1::int::variant.variant("test variant") = 2::int::variant.variant("test variant") AS eq
+;
+
+SELECT cmp_ok(
+  (SELECT backend FROM variant.stats WHERE stat_name = 'spi_cmp')
+  , '>='
+  , 1::bigint
+  , 'spi_cmp counted'
+);
+SELECT cmp_ok(
+  (SELECT sum(backend)::bigint FROM variant.stats WHERE stat_name IN( 'spi_get_variant_name', 'registry_hits' ))
+  , '>='
+  , 2::bigint
+  , 'registry lookups counted'
+);
+SELECT cmp_ok(
+  (SELECT backend FROM variant.stats WHERE stat_name = 'cache_misses')
+  , '>='
+  , 1::bigint
+  , 'cache_misses counted'
+);
+
+SELECT finish();
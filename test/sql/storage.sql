@@ -11,7 +11,7 @@ SELECT plan( (
     + 2 -- can't drop event triggers
     + 5 -- Storage allowed
     + 12 -- Not extension
-	+ 5 -- storage OK
+	+ 6 -- storage OK
 )::int );
 
 -- Need to run all this stuff as a superuser
@@ -164,5 +164,9 @@ SELECT lives_ok(
 	, 'Can disallow storage'
 );
 SELECT is( storage_allowed, false, 'test storage disallows storage' ) FROM _variant.registered__get( 'test storage' ) a;
+SELECT lives_ok(
+	$$CREATE TEMP TABLE storage_test_no_variant( i int )$$
+	, 'Can CREATE TABLE without variants'
+);
 
 SELECT finish();
@@ -0,0 +1,39 @@
+\set ECHO none
+BEGIN;
+\i test/helpers/tap_setup.sql
+\i test/helpers/common.sql
+
+CREATE TEMP TABLE storage_stats_test( v variant.variant("test variant") );
+INSERT INTO storage_stats_test VALUES
+  ( 1::int::variant.variant("test variant") )
+  , ( 1.5::float::variant.variant("test variant") )
+  , ( 'abc'::text::variant.variant("test variant") )
+  , ( repeat( 'x', 100000 )::text::variant.variant("test variant") )
+;
+
+SELECT plan( (
+  3 -- storage_stats
+)::int );
+
+SELECT results_eq(
+  $$SELECT column_name, original_type, row_count, padding_bytes, overflow_bytes
+      FROM variant.storage_stats( 'storage_stats_test' )$$
+  , $$VALUES
+        ( 'v'::name, 'integer'::regtype, 1::bigint, 0::bigint, 0::bigint )
+      , ( 'v', 'text', 2, 0, 0 )
+      , ( 'v', 'double precision', 1, 4, 0 )
+    $$
+  , 'storage_stats() by type'
+);
+SELECT is(
+  (SELECT payload_bytes FROM variant.storage_stats( 'storage_stats_test' ) WHERE original_type = 'text')
+  , 100003::bigint
+  , 'storage_stats() payload_bytes'
+);
+SELECT is(
+  (SELECT compressed_count FROM variant.storage_stats( 'storage_stats_test' ) WHERE original_type = 'text')
+  , 1::bigint
+  , 'storage_stats() counts compressed values'
+);
+
+SELECT finish();
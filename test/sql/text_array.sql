@@ -0,0 +1,47 @@
+\set ECHO none
+BEGIN;
+\i test/helpers/tap_setup.sql
+\i test/helpers/common.sql
+
+SELECT plan( (
+  3 -- conversion
+  +3 -- errors
+)::int );
+
+SELECT is(
+  variant.from_text_array( '{42,"some text",1.5,7}', '{int4,text,numeric,int4}', 'test variant' )
+  , array[ 42::int::variant.variant("test variant"), 'some text'::text::variant.variant("test variant")
+    , 1.5::numeric::variant.variant("test variant"), 7::int::variant.variant("test variant") ]
+  , 'from_text_array()'
+);
+SELECT is(
+  variant.from_text_array( '{NULL}', '{int4}', 'test variant' )
+  , array[ '(integer,)'::variant.variant("test variant") ]
+  , 'from_text_array() NULL value'
+);
+SELECT is(
+  variant.from_text_array( '{}', '{}', 'test variant' )
+  , '{}'::variant.variant[]
+  , 'from_text_array() empty array'
+);
+
+SELECT throws_ok(
+  $$SELECT variant.from_text_array( '{1,2}', '{int4}', 'test variant' )$$
+  , '2202E'
+  , 'got 2 values but 1 types'
+  , 'from_text_array() with mismatched arrays'
+);
+SELECT throws_ok(
+  $$SELECT variant.from_text_array( '{1}', '{timestamptz}', 'test variant' )$$
+  , '22023'
+  , 'type timestamp with time zone is not allowed in variant.variant(test variant)'
+  , 'from_text_array() with disallowed type'
+);
+SELECT throws_ok(
+  $$SELECT variant.from_text_array( '{a}', '{int4}', 'test variant' )$$
+  , '22P02'
+  , NULL
+  , 'from_text_array() with bad input'
+);
+
+SELECT finish();